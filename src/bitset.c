@@ -0,0 +1,65 @@
+#include <glib.h>
+#include <string.h>
+
+#include "bitset.h"
+
+#define WORD_BITS 64
+
+bitset_t *
+bitset_new(void)
+{
+  return g_new0(bitset_t, 1);
+}
+
+void
+bitset_free(bitset_t *set)
+{
+  if (set == NULL) {
+    return;
+  }
+  g_free(set->words);
+  g_free(set);
+}
+
+void
+bitset_add(bitset_t *set, guint32 bit)
+{
+  guint32 word = bit / WORD_BITS;
+
+  g_assert(set);
+
+  if (word >= set->n_words) {
+    guint32 n_words = MAX(word + 1, set->n_words * 2);
+
+    set->words = g_renew(guint64, set->words, n_words);
+    memset(set->words + set->n_words, 0,
+           (n_words - set->n_words) * sizeof(guint64));
+    set->n_words = n_words;
+  }
+  set->words[word] |= G_GUINT64_CONSTANT(1) << (bit % WORD_BITS);
+}
+
+void
+bitset_remove(bitset_t *set, guint32 bit)
+{
+  guint32 word = bit / WORD_BITS;
+
+  g_assert(set);
+
+  if (word < set->n_words) {
+    set->words[word] &= ~(G_GUINT64_CONSTANT(1) << (bit % WORD_BITS));
+  }
+}
+
+gboolean
+bitset_contains(const bitset_t *set, guint32 bit)
+{
+  guint32 word = bit / WORD_BITS;
+
+  g_assert(set);
+
+  if (word >= set->n_words) {
+    return FALSE;
+  }
+  return (set->words[word] >> (bit % WORD_BITS)) & 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A dense set of small integers like identifier ids, grown on demand */
+typedef struct bitset bitset_t;
+
+struct bitset {
+  guint64 *words;
+  guint32 n_words;
+};
+
+bitset_t *bitset_new(void);
+
+void bitset_free(bitset_t *set);
+
+void bitset_add(bitset_t *set, guint32 bit);
+
+void bitset_remove(bitset_t *set, guint32 bit);
+
+gboolean bitset_contains(const bitset_t *set, guint32 bit);
+
+G_END_DECLS
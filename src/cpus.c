@@ -0,0 +1,81 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <sched.h>
+
+#include "cpus.h"
+
+#define CGROUP2_CPU_MAX     "/sys/fs/cgroup/cpu.max"
+#define CGROUP1_CFS_QUOTA   "/sys/fs/cgroup/cpu/cpu.cfs_quota_us"
+#define CGROUP1_CFS_PERIOD  "/sys/fs/cgroup/cpu/cpu.cfs_period_us"
+
+static gint64
+read_number(const gchar *path)
+{
+  gchar *content = NULL;
+  gint64 res;
+
+  g_assert(path);
+
+  if (!g_file_get_contents(path, &content, NULL, NULL)) {
+    return -1;
+  }
+  res = g_ascii_strtoll(content, NULL, 10);
+  g_free(content);
+
+  return res;
+}
+
+static guint
+affinity_cpus(void)
+{
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return g_get_num_processors();
+  }
+  return CPU_COUNT(&set);
+}
+
+/* Returns 0 when there is no quota */
+static guint
+quota_cpus(void)
+{
+  gchar *content = NULL;
+  gchar **fields = NULL;
+  gint64 quota = -1;
+  gint64 period = -1;
+
+  /* cgroup v2: "<quota> <period>" or "max <period>" */
+  if (g_file_get_contents(CGROUP2_CPU_MAX, &content, NULL, NULL)) {
+    fields = g_strsplit(g_strstrip(content), " ", 2);
+    if (g_strv_length(fields) == 2 && g_strcmp0(fields[0], "max") != 0) {
+      quota = g_ascii_strtoll(fields[0], NULL, 10);
+      period = g_ascii_strtoll(fields[1], NULL, 10);
+    }
+    g_strfreev(fields);
+    g_free(content);
+  } else {
+    /* cgroup v1, a quota of -1 means unlimited */
+    quota = read_number(CGROUP1_CFS_QUOTA);
+    period = read_number(CGROUP1_CFS_PERIOD);
+  }
+
+  if (quota <= 0 || period <= 0) {
+    return 0;
+  }
+  /* Round up, half a CPU is still worth a thread */
+  return (quota + period - 1) / period;
+}
+
+guint
+cpus_available(void)
+{
+  guint cpus = affinity_cpus();
+  guint quota = quota_cpus();
+
+  if (quota > 0) {
+    cpus = MIN(cpus, quota);
+  }
+  return MAX(cpus, 1);
+}
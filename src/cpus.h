@@ -0,0 +1,10 @@
+#pragma once
+
+#include <glib.h>
+#include "glibconfig.h"
+
+G_BEGIN_DECLS
+
+guint cpus_available(void);
+
+G_END_DECLS
@@ -0,0 +1,86 @@
+#include <glib.h>
+#include <string.h>
+
+#include "doc_comment.h"
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+#define IS_SPACE(c) (IS_BLANK(c) || (c) == '\r' || (c) == '\n')
+
+static gboolean
+word_eq(const gchar *word, gsize len, const gchar *expected)
+{
+  return strlen(expected) == len && memcmp(word, expected, len) == 0;
+}
+
+/* The name after @param, which has to be on the same line */
+static void
+param_arg(struct doc_tag *tag, const gchar *p, const gchar *end)
+{
+  const gchar *arg;
+
+  g_assert(tag);
+
+  /* Direction like [in], [out] or [in,out] */
+  if (p < end && *p == '[') {
+    const gchar *close = memchr(p, ']', end - p);
+
+    if (close == NULL) {
+      return;
+    }
+    p = close + 1;
+  }
+  while (p < end && IS_BLANK(*p)) {
+    p++;
+  }
+  arg = p;
+  while (p < end && !IS_SPACE(*p)) {
+    p++;
+  }
+  if (p > arg) {
+    tag->arg = arg;
+    tag->arg_len = p - arg;
+  }
+}
+
+void
+doc_comment_tags(const gchar *text, gsize len, GArray *tags)
+{
+  const gchar *end = text + len;
+  const gchar *p = text;
+
+  g_assert(text);
+  g_assert(tags);
+
+  while ((p = memchr(p, '@', end - p)) != NULL) {
+    struct doc_tag tag = {0};
+    const gchar *word = ++p;
+
+    while (p < end && g_ascii_isalpha(*p)) {
+      p++;
+    }
+
+    if (word_eq(word, p - word, "brief")) {
+      tag.kind = DOC_TAG_BRIEF;
+    } else if (word_eq(word, p - word, "param")) {
+      tag.kind = DOC_TAG_PARAM;
+      param_arg(&tag, p, end);
+    } else if (word_eq(word, p - word, "return") ||
+               word_eq(word, p - word, "returns")) {
+      tag.kind = DOC_TAG_RETURN;
+    } else {
+      continue;
+    }
+    tag.start = word - 1;
+    tag.len = p - tag.start;
+    g_array_append_val(tags, tag);
+  }
+}
+
+gboolean
+doc_comment_arg_eq(const struct doc_tag *tag, const gchar *name)
+{
+  g_assert(tag);
+  g_assert(name);
+
+  return tag->arg != NULL && word_eq(tag->arg, tag->arg_len, name);
+}
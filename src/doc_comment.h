@@ -0,0 +1,33 @@
+#pragma once
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The tags of a doc comment, found in one pass without copying: the spans
+ * point into the document */
+
+enum doc_tag_kind {
+  DOC_TAG_BRIEF = 0,
+  DOC_TAG_PARAM,
+  /* @return and @returns */
+  DOC_TAG_RETURN,
+};
+
+struct doc_tag {
+  enum doc_tag_kind kind;
+  /* The tag from its @ */
+  const gchar *start;
+  guint32 len;
+  /* Name of a @param, @param[in] and the like included, NULL if missing */
+  const gchar *arg;
+  guint32 arg_len;
+};
+
+/* Appends the tags of the len bytes of text to tags, a GArray of
+ * struct doc_tag. Tags other than the ones above are skipped. */
+void doc_comment_tags(const gchar *text, gsize len, GArray *tags);
+
+/* Whether the arg of tag is name */
+gboolean doc_comment_arg_eq(const struct doc_tag *tag, const gchar *name);
+
+G_END_DECLS
@@ -0,0 +1,223 @@
+#include <glib.h>
+#include <string.h>
+#include <tree_sitter/api.h>
+
+#include "function_cache.h"
+#include "problems.h"
+
+#define HASH_SEED  G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)
+#define HASH_MUL   G_GUINT64_CONSTANT(0xff51afd7ed558ccd)
+
+struct cache_key {
+  guint64 key;
+  guint rule;
+};
+
+struct cache_entry {
+  struct cache_key key;
+  /* Problems with lines relative to the origin, and characters too on the
+   * line of the origin, NULL if there are none */
+  problems_t *problems;
+};
+
+struct function_cache {
+  /* struct cache_entry by struct cache_key, the entry owns the key */
+  GHashTable *entries;
+  /* Entries from the oldest, dropped first */
+  GQueue order;
+  guint max_entries;
+  GMutex lock;
+  struct function_cache_stats stats;
+};
+
+static guint
+key_hash(gconstpointer data)
+{
+  const struct cache_key *k = (const struct cache_key *) data;
+
+  return (guint) (k->key ^ (k->key >> 32)) ^ k->rule;
+}
+
+static gboolean
+key_equal(gconstpointer a, gconstpointer b)
+{
+  const struct cache_key *ka = (const struct cache_key *) a;
+  const struct cache_key *kb = (const struct cache_key *) b;
+
+  return ka->key == kb->key && ka->rule == kb->rule;
+}
+
+static void
+entry_free(gpointer data)
+{
+  struct cache_entry *e = (struct cache_entry *) data;
+
+  if (e == NULL) {
+    return;
+  }
+  problems_free(e->problems);
+  g_free(e);
+}
+
+/* Moves a position from the origin from to the origin to */
+static void
+move(guint32 *line, guint32 *character, TSPoint from, TSPoint to)
+{
+  if (*line == from.row) {
+    *character += to.column - from.column;
+  }
+  *line += to.row - from.row;
+}
+
+/* Adds a copy of the problem at i of src to dst, moved from the origin from
+ * to the origin to */
+static void
+copy_moved(problems_t *dst, const problems_t *src, guint i, TSPoint from,
+           TSPoint to)
+{
+  struct problem *p;
+
+  problems_add_copy(dst, src, i);
+  p = problems_get(dst, problems_len(dst) - 1);
+  move(&p->start_line, &p->start_char, from, to);
+  move(&p->end_line, &p->end_char, from, to);
+}
+
+function_cache_t *
+function_cache_new(guint max_entries)
+{
+  function_cache_t *cache;
+
+  g_return_val_if_fail(max_entries > 0, NULL);
+
+  cache = g_malloc0(sizeof(*cache));
+  cache->entries = g_hash_table_new_full(key_hash, key_equal, NULL,
+                                         entry_free);
+  g_queue_init(&cache->order);
+  cache->max_entries = max_entries;
+  g_mutex_init(&cache->lock);
+
+  return cache;
+}
+
+void
+function_cache_free(function_cache_t *cache)
+{
+  if (cache == NULL) {
+    return;
+  }
+  g_queue_clear(&cache->order);
+  g_hash_table_unref(cache->entries);
+  g_mutex_clear(&cache->lock);
+  g_free(cache);
+}
+
+guint64
+function_cache_hash(const gchar *data, gsize len)
+{
+  guint64 h = HASH_SEED ^ len;
+  gsize i = 0;
+
+  g_return_val_if_fail(data != NULL || len == 0, 0);
+
+  /* Eight bytes at a time, then the tail */
+  for (; i + sizeof(guint64) <= len; i += sizeof(guint64)) {
+    guint64 word;
+
+    memcpy(&word, data + i, sizeof(word));
+    h = (h ^ word) * HASH_MUL;
+    h ^= h >> 29;
+  }
+  for (; i < len; i++) {
+    h = (h ^ (guchar) data[i]) * HASH_MUL;
+  }
+  h ^= h >> 33;
+  h *= HASH_SEED;
+  h ^= h >> 33;
+
+  return h;
+}
+
+gboolean
+function_cache_lookup(function_cache_t *cache,
+                      guint64 key,
+                      guint rule,
+                      TSPoint origin,
+                      problems_t *problems)
+{
+  struct cache_key k = {key, rule};
+  struct cache_entry *e;
+  TSPoint zero = {0, 0};
+
+  g_return_val_if_fail(cache != NULL, FALSE);
+  g_return_val_if_fail(problems != NULL, FALSE);
+
+  g_mutex_lock(&cache->lock);
+  cache->stats.lookups++;
+  e = g_hash_table_lookup(cache->entries, &k);
+  if (e != NULL) {
+    cache->stats.hits++;
+    for (guint i = 0; i < problems_len(e->problems); i++) {
+      copy_moved(problems, e->problems, i, zero, origin);
+    }
+  }
+  g_mutex_unlock(&cache->lock);
+
+  return e != NULL;
+}
+
+void
+function_cache_store(function_cache_t *cache,
+                     guint64 key,
+                     guint rule,
+                     TSPoint origin,
+                     const problems_t *problems,
+                     const guint *which,
+                     guint n)
+{
+  struct cache_entry *e;
+  TSPoint zero = {0, 0};
+
+  g_return_if_fail(cache != NULL);
+  g_return_if_fail(n == 0 || (problems != NULL && which != NULL));
+
+  e = g_malloc0(sizeof(*e));
+  e->key.key = key;
+  e->key.rule = rule;
+  if (n > 0) {
+    e->problems = problems_new();
+    for (guint i = 0; i < n; i++) {
+      copy_moved(e->problems, problems, which[i], origin, zero);
+    }
+  }
+
+  g_mutex_lock(&cache->lock);
+  if (g_hash_table_contains(cache->entries, &e->key)) {
+    /* Another worker analyzed the same code meanwhile */
+    g_mutex_unlock(&cache->lock);
+    entry_free(e);
+    return;
+  }
+  while (cache->order.length >= cache->max_entries) {
+    struct cache_entry *old = g_queue_pop_head(&cache->order);
+
+    g_hash_table_remove(cache->entries, &old->key);
+    cache->stats.evictions++;
+  }
+  g_hash_table_insert(cache->entries, &e->key, e);
+  g_queue_push_tail(&cache->order, e);
+  cache->stats.entries = cache->order.length;
+  g_mutex_unlock(&cache->lock);
+}
+
+void
+function_cache_get_stats(function_cache_t *cache,
+                         struct function_cache_stats *stats)
+{
+  g_return_if_fail(cache != NULL);
+  g_return_if_fail(stats != NULL);
+
+  g_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  g_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+#include "problems.h"
+
+G_BEGIN_DECLS
+
+/* Problems of every rule by fingerprint of a top level declaration and its
+ * doc comment, shared by all documents and kept across edits. Positions are
+ * stored relative to the start of what was fingerprinted, so declarations
+ * that moved reuse them. */
+typedef struct function_cache function_cache_t;
+
+struct function_cache_stats {
+  guint64 lookups;
+  guint64 hits;
+  /* Entries held now */
+  guint64 entries;
+  /* Entries dropped to stay within the limit */
+  guint64 evictions;
+};
+
+function_cache_t *function_cache_new(guint max_entries);
+
+void function_cache_free(function_cache_t *cache);
+
+/* Fingerprint of the len bytes of data */
+guint64 function_cache_hash(const gchar *data, gsize len);
+
+/* Adds copies of the problems of rule for key, moved to origin, to
+ * problems. FALSE if they are not known. */
+gboolean function_cache_lookup(function_cache_t *cache,
+                               guint64 key,
+                               guint rule,
+                               TSPoint origin,
+                               problems_t *problems);
+
+/* Keeps copies of the n problems at indexes which that rule found with the
+ * fingerprinted text at origin */
+void function_cache_store(function_cache_t *cache,
+                          guint64 key,
+                          guint rule,
+                          TSPoint origin,
+                          const problems_t *problems,
+                          const guint *which,
+                          guint n);
+
+void function_cache_get_stats(function_cache_t *cache,
+                              struct function_cache_stats *stats);
+
+G_END_DECLS
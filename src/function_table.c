@@ -0,0 +1,901 @@
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+#include "bitset.h"
+#include "function_table.h"
+#include "node_table.h"
+#include "parse_utils.h"
+#include "parser.h"
+#include "summary_store.h"
+
+#define SUMMARY_HASH_MUL G_GUINT64_CONSTANT(0x100000001b3)
+
+/* State while a table is built, the cursor is reset for every walk so
+ * that its stack is only allocated once */
+struct builder {
+  function_table_t *table;
+  parser_t *parser;
+  TSTreeCursor cursor;
+  /* Asserted identifiers of the function being summarized */
+  bitset_t *asserts;
+};
+
+/* Collects below the node under the cursor, which is left where it was */
+static void
+collect_asserts(GArray *res,
+                const gchar *content,
+                const node_table_t *nodes,
+                TSTreeCursor *cursor)
+{
+  g_assert(res);
+  g_assert(content);
+  g_assert(cursor);
+
+  if (!parse_utils_cursor_first_named_child(cursor)) {
+    return;
+  }
+  do {
+    TSNode args;
+    TSNode arg;
+    TSNode function;
+    gboolean found = FALSE;
+    TSNode n = ts_tree_cursor_current_node(cursor);
+
+    if (ts_node_symbol(n) != SYMBOL_CALL_EXPRESSION) {
+      collect_asserts(res, content, nodes, cursor);
+      continue;
+    }
+
+    function = ts_node_child_by_field_id(n, FIELD_FUNCTION);
+    args = ts_node_child_by_field_id(n, FIELD_ARGUMENTS);
+
+    if (ts_node_is_null(function) || ts_node_is_null(args)) {
+      goto out;
+    }
+
+    if (ts_node_named_child_count(args) != 1) {
+      /* g_assert should have exactly 1 arg */
+      goto out;
+    }
+    if (!parse_utils_node_eq(content, &function, "g_assert")) {
+      goto out;
+    }
+    arg = node_table_first(nodes, args, SYMBOL_IDENTIFIER, &found);
+
+    if (found) {
+      guint32 id = node_table_ident(nodes, arg);
+
+      g_array_append_val(res, id);
+    }
+  } while (parse_utils_cursor_next_named_sibling(cursor));
+
+  /* Fall through */
+out:
+  ts_tree_cursor_goto_parent(cursor);
+}
+
+/* Collects below the node under the cursor, which is left where it was */
+static void
+collect_renames(GArray *res,
+                const gchar *content,
+                const node_table_t *nodes,
+                TSTreeCursor *cursor)
+{
+  struct function_rename rename;
+
+  g_assert(res);
+  g_assert(content);
+  g_assert(cursor);
+
+  if (!parse_utils_cursor_first_named_child(cursor)) {
+    return;
+  }
+  do {
+    TSNode n = ts_tree_cursor_current_node(cursor);
+    TSNode decl;
+    TSNode to;
+    TSNode from;
+    TSNode to_cast;
+    TSNode from_cast;
+
+    if (ts_node_symbol(n) != SYMBOL_DECLARATION) {
+      collect_renames(res, content, nodes, cursor);
+      continue;
+    }
+
+    decl = ts_node_child_by_field_id(n, FIELD_DECLARATOR);
+    to = node_table_first(nodes, decl, SYMBOL_IDENTIFIER, NULL);
+
+    from = node_table_first(nodes, decl, SYMBOL_CAST_EXPRESSION, NULL);
+
+    if (parse_utils_is_gobject_cast(content, nodes, n, &to_cast,
+                                    &from_cast)) {
+      rename.from = node_table_ident(nodes, from_cast);
+      rename.to = node_table_ident(nodes, to_cast);
+      g_array_append_val(res, rename);
+      goto out;
+    }
+
+    if (ts_node_symbol(from) != SYMBOL_CAST_EXPRESSION) {
+      continue;
+    }
+
+    from = node_table_first(nodes, from, SYMBOL_IDENTIFIER, NULL);
+
+    if (ts_node_symbol(from) != SYMBOL_IDENTIFIER ||
+        ts_node_symbol(to) != SYMBOL_IDENTIFIER) {
+      continue;
+    }
+    rename.from = node_table_ident(nodes, from);
+    rename.to = node_table_ident(nodes, to);
+    g_array_append_val(res, rename);
+    goto out;
+  } while (parse_utils_cursor_next_named_sibling(cursor));
+
+  /* Fall through */
+out:
+  ts_tree_cursor_goto_parent(cursor);
+}
+
+/* Id of the identifier at index, alone or cast, 0 for anything else */
+static guint32
+passed_ident(const node_table_t *nodes, gint index)
+{
+  const struct node_entry *entries;
+
+  g_assert(nodes);
+
+  entries = (const struct node_entry *) nodes->entries->data;
+  if (entries[index].symbol == SYMBOL_CAST_EXPRESSION) {
+    gint value = node_table_first_child(nodes, index);
+
+    /* The value follows the type */
+    while (value >= 0 && node_table_next_sibling(nodes, value) >= 0) {
+      value = node_table_next_sibling(nodes, value);
+    }
+    index = value;
+  }
+  if (index < 0 || entries[index].symbol != SYMBOL_IDENTIFIER) {
+    return 0;
+  }
+  return g_array_index(nodes->idents, guint32, index);
+}
+
+/* Identifiers passed to the functions called below the node at index */
+static void
+collect_forwards(GArray *res, const node_table_t *nodes, guint32 index)
+{
+  const struct node_entry *entries;
+  const guint32 *calls;
+  guint count;
+
+  g_assert(res);
+  g_assert(nodes);
+
+  entries = (const struct node_entry *) nodes->entries->data;
+  calls = node_table_all(nodes, index, SYMBOL_CALL_EXPRESSION, &count);
+
+  for (guint i = 0; i < count; i++) {
+    struct function_forward forward;
+    gint function;
+    gint args;
+
+    function = node_table_first_child(nodes, calls[i]);
+    if (function < 0 || entries[function].symbol != SYMBOL_IDENTIFIER) {
+      continue;
+    }
+    args = node_table_next_sibling(nodes, function);
+    if (args < 0 || entries[args].symbol != SYMBOL_ARG_LIST) {
+      continue;
+    }
+
+    forward.callee = g_array_index(nodes->idents, guint32, function);
+    forward.index = 0;
+    for (gint arg = node_table_first_child(nodes, args); arg >= 0;
+         arg = node_table_next_sibling(nodes, arg)) {
+      if (entries[arg].symbol == SYMBOL_COMMENT) {
+        continue;
+      }
+      forward.arg = passed_ident(nodes, arg);
+      if (forward.arg != 0) {
+        g_array_append_val(res, forward);
+      }
+      forward.index++;
+    }
+  }
+}
+
+static gboolean
+contains_gerror_check(const gchar *content, TSTreeCursor *cursor)
+{
+  gboolean res = FALSE;
+
+  g_assert(content);
+  g_assert(cursor);
+
+  if (!parse_utils_cursor_first_named_child(cursor)) {
+    return FALSE;
+  }
+  do {
+    TSNode n = ts_tree_cursor_current_node(cursor);
+    if (parse_utils_node_eq(content, &n, "err == NULL || *err == NULL") ||
+        contains_gerror_check(content, cursor)) {
+      res = TRUE;
+      break;
+    }
+  } while (parse_utils_cursor_next_named_sibling(cursor));
+  ts_tree_cursor_goto_parent(cursor);
+
+  return res;
+}
+
+/* The function_declarator below any pointer declarators, null if none */
+static TSNode
+function_declarator(TSNode decl)
+{
+  TSNode none = {0};
+
+  while (!ts_node_is_null(decl) &&
+         ts_node_symbol(decl) == SYMBOL_POINTER_DECLARATION) {
+    decl = ts_node_child_by_field_id(decl, FIELD_DECLARATOR);
+  }
+  if (ts_node_is_null(decl) ||
+      ts_node_symbol(decl) != SYMBOL_FUNC_DECLARATION) {
+    return none;
+  }
+  return decl;
+}
+
+static void
+add_params(struct builder *b, struct function_info *info)
+{
+  parser_t *parser;
+  TSTreeCursor *cursor;
+
+  g_assert(b);
+  g_assert(info);
+
+  parser = b->parser;
+  cursor = &b->cursor;
+  info->params_start = b->table->params->len;
+
+  ts_tree_cursor_reset(cursor, info->param_list);
+  if (!parse_utils_cursor_first_named_child(cursor)) {
+    return;
+  }
+  do {
+    struct function_param param = {0};
+    TSNode name;
+    gboolean found = FALSE;
+
+    param.node = ts_tree_cursor_current_node(cursor);
+    param.ident = node_table_first(parser->nodes, param.node,
+                                   SYMBOL_IDENTIFIER, &found);
+    if (!found) {
+      param.ident = (TSNode) {0};
+    }
+    param.unused = parse_utils_parameter_is_unused(parser->content,
+                                                   param.node);
+    param.pointer = parse_utils_parameter_is_pointer(parser->content,
+                                                     parser->nodes,
+                                                     param.node, &name);
+    if (param.pointer) {
+      param.name = node_table_ident(parser->nodes, name);
+    } else if (found) {
+      param.name = node_table_ident(parser->nodes, param.ident);
+    }
+    param.gerror = parse_utils_node_eq(parser->content, &param.node,
+                                       "GError **err");
+    g_array_append_val(b->table->params, param);
+  } while (parse_utils_cursor_next_named_sibling(cursor));
+
+  info->n_params = b->table->params->len - info->params_start;
+}
+
+/* Appends the comments below the function lowercased */
+static void
+add_comments(struct builder *b, struct function_info *info)
+{
+  function_table_t *table;
+  parser_t *parser;
+  const guint32 *comments;
+  guint count;
+  gint index;
+
+  g_assert(b);
+  g_assert(info);
+
+  table = b->table;
+  parser = b->parser;
+  info->comments_start = table->comments->len;
+
+  index = node_table_index(parser->nodes, info->node);
+  if (index < 0) {
+    return;
+  }
+  comments = node_table_all(parser->nodes, index, SYMBOL_COMMENT, &count);
+
+  for (guint i = 0; i < count; i++) {
+    TSNode n = node_table_node(parser->nodes, comments[i]);
+    struct function_comment comment;
+    gchar *text;
+
+    comment.start = table->comment_text->len;
+    comment.len = ts_node_end_byte(n) - ts_node_start_byte(n);
+    g_string_append_len(table->comment_text,
+                        parser->content + ts_node_start_byte(n), comment.len);
+
+    text = table->comment_text->str + comment.start;
+    for (guint32 j = 0; j < comment.len; j++) {
+      text[j] = g_ascii_tolower(text[j]);
+    }
+    comment.null = g_strstr_len(text, comment.len, "null") != NULL;
+    g_array_append_val(table->comments, comment);
+  }
+
+  info->n_comments = table->comments->len - info->comments_start;
+}
+
+/* What the summaries of definitions need */
+static void
+add_body_facts(struct builder *b, struct function_info *info)
+{
+  function_table_t *table;
+  parser_t *parser;
+  gint index;
+
+  g_assert(b);
+  g_assert(info);
+
+  table = b->table;
+  parser = b->parser;
+  info->asserts_start = table->asserts->len;
+  info->renames_start = table->renames->len;
+  info->forwards_start = table->forwards->len;
+
+  /* Walks below the function and is always brought back to it */
+  ts_tree_cursor_reset(&b->cursor, info->node);
+  collect_asserts(table->asserts, parser->content, parser->nodes, &b->cursor);
+  collect_renames(table->renames, parser->content, parser->nodes, &b->cursor);
+  index = node_table_index(parser->nodes, info->node);
+  if (index >= 0) {
+    collect_forwards(table->forwards, parser->nodes, index);
+  }
+
+  info->n_asserts = table->asserts->len - info->asserts_start;
+  info->n_renames = table->renames->len - info->renames_start;
+  info->n_forwards = table->forwards->len - info->forwards_start;
+}
+
+/* What only the asserts of static functions need */
+static void
+add_static_facts(struct builder *b, struct function_info *info)
+{
+  function_table_t *table;
+  parser_t *parser;
+  const struct function_param *params;
+
+  g_assert(b);
+  g_assert(info);
+
+  table = b->table;
+  parser = b->parser;
+  add_comments(b, info);
+
+  params = function_table_params(table, info);
+  for (guint i = 0; i < info->n_params; i++) {
+    if (params[i].gerror) {
+      ts_tree_cursor_reset(&b->cursor, info->node);
+      info->gerror_checked = contains_gerror_check(parser->content,
+                                                   &b->cursor);
+      break;
+    }
+  }
+}
+
+static void
+add_function(struct builder *b, guint32 index, enum function_kind kind)
+{
+  struct function_info info = {0};
+  const struct node_entry *entries;
+  gint32 prev;
+  parser_t *parser;
+  TSNode n;
+  TSNode decl;
+
+  g_assert(b);
+
+  parser = b->parser;
+  entries = (const struct node_entry *) parser->nodes->entries->data;
+  n = node_table_node(parser->nodes, index);
+  info.node = n;
+  info.kind = kind;
+  info.start_byte = ts_node_start_byte(n);
+  info.end_byte = ts_node_end_byte(n);
+  info.is_static = parse_utils_is_function_static(parser->content,
+                                                  parser->nodes, n);
+
+  /* The table knows the previous sibling, no need to search for it */
+  prev = entries[index].prev;
+  if (prev >= 0 && entries[prev].symbol == SYMBOL_COMMENT) {
+    info.doc = node_table_node(parser->nodes, prev);
+  }
+
+  decl = function_declarator(ts_node_child_by_field_id(n, FIELD_DECLARATOR));
+  if (!ts_node_is_null(decl)) {
+    info.name = node_table_ident(parser->nodes,
+                                 ts_node_child_by_field_id(decl,
+                                                           FIELD_DECLARATOR));
+    info.param_list = ts_node_child_by_field_id(decl, FIELD_PARAMETERS);
+  }
+  if (!ts_node_is_null(info.param_list)) {
+    add_params(b, &info);
+  }
+
+  if (kind == FUNCTION_KIND_DEFINITION) {
+    add_body_facts(b, &info);
+    if (info.is_static) {
+      add_static_facts(b, &info);
+    }
+  }
+
+  g_array_append_val(b->table->functions, info);
+}
+
+/* The last rename of param, 0 if there is none */
+static guint32
+renamed_to(const struct function_rename *renames,
+           guint n_renames,
+           guint32 param)
+{
+  for (guint i = n_renames; i > 0; i--) {
+    if (renames[i - 1].from == param) {
+      return renames[i - 1].to;
+    }
+  }
+  return 0;
+}
+
+/* Whether param is passed on as arg, directly or renamed. A chain without
+ * cycles is never longer than the renames, which ends cycles like a = b;
+ * b = a; */
+static gboolean
+renamed_to_arg(const struct function_rename *renames,
+               guint n_renames,
+               guint32 param,
+               guint32 arg)
+{
+  for (guint step = 0; param != 0 && step <= n_renames; step++) {
+    if (param == arg) {
+      return TRUE;
+    }
+    param = renamed_to(renames, n_renames, param);
+  }
+  return FALSE;
+}
+
+/* Follows the renames of param */
+static gboolean
+renamed_assert(const bitset_t *asserts,
+               const struct function_rename *renames,
+               guint n_renames,
+               guint32 param)
+{
+  g_assert(asserts);
+
+  for (guint step = 0; param != 0 && step <= n_renames; step++) {
+    if (bitset_contains(asserts, param)) {
+      return TRUE;
+    }
+    param = renamed_to(renames, n_renames, param);
+  }
+  return FALSE;
+}
+
+static struct function_param *
+param_at(function_table_t *table, const struct function_info *info, guint i)
+{
+  return &g_array_index(table->params, struct function_param,
+                        info->params_start + i);
+}
+
+/* Marks the parameters the function asserts itself */
+static void
+summarize_direct(struct builder *b, const struct function_info *info)
+{
+  const guint32 *ids;
+
+  g_assert(b);
+  g_assert(info);
+
+  ids = function_table_asserts(b->table, info);
+  for (guint i = 0; i < info->n_asserts; i++) {
+    bitset_add(b->asserts, ids[i]);
+  }
+
+  for (guint i = 0; i < info->n_params; i++) {
+    struct function_param *param = param_at(b->table, info, i);
+
+    param->asserted = renamed_assert(b->asserts,
+                                     function_table_renames(b->table, info),
+                                     info->n_renames, param->name);
+  }
+
+  /* Leave the set empty for the next function */
+  for (guint i = 0; i < info->n_asserts; i++) {
+    bitset_remove(b->asserts, ids[i]);
+  }
+}
+
+/* Whether the function called as forward asserts what it is passed.
+ * defined maps the names of the definitions of the file to their index + 1,
+ * external holds what other files assert, indexed like the forwards. */
+static gboolean
+callee_asserts(struct builder *b,
+               GHashTable *defined,
+               const guint64 *external,
+               guint f)
+{
+  const struct function_forward *forward;
+  const struct function_info *callee;
+  gpointer name;
+  guint index;
+
+  g_assert(b);
+  g_assert(defined);
+
+  forward = &g_array_index(b->table->forwards, struct function_forward, f);
+  name = GUINT_TO_POINTER(forward->callee);
+  index = GPOINTER_TO_UINT(g_hash_table_lookup(defined, name));
+  if (index == 0) {
+    return forward->index < SUMMARY_STORE_MAX_PARAMS &&
+           (external[f] >> forward->index & 1) != 0;
+  }
+  callee = &g_array_index(b->table->functions, struct function_info,
+                          index - 1);
+  return forward->index < callee->n_params &&
+         param_at(b->table, callee, forward->index)->asserted;
+}
+
+/* Marks the asserted parameters of the definitions, passing a parameter to
+ * a function that asserts it counts. Calls within the file are followed
+ * until nothing changes, those to other files use the summaries of the
+ * store. */
+static void
+add_summaries(struct builder *b)
+{
+  function_table_t *table;
+  parser_t *parser;
+  GHashTable *defined;
+  guint64 *external;
+  gboolean changed;
+
+  g_assert(b);
+
+  table = b->table;
+  parser = b->parser;
+  defined = g_hash_table_new(NULL, NULL);
+  for (guint i = 0; i < table->functions->len; i++) {
+    struct function_info *info;
+
+    info = &g_array_index(table->functions, struct function_info, i);
+    if (info->kind == FUNCTION_KIND_DEFINITION) {
+      summarize_direct(b, info);
+      if (info->name != 0) {
+        g_hash_table_insert(defined, GUINT_TO_POINTER(info->name),
+                            GUINT_TO_POINTER(i + 1));
+      }
+    }
+  }
+
+  /* Other files are asked once per call */
+  external = g_new0(guint64, table->forwards->len);
+  for (guint f = 0; parser->summaries != NULL && f < table->forwards->len;
+       f++) {
+    const struct function_forward *forward;
+
+    forward = &g_array_index(table->forwards, struct function_forward, f);
+    if (!g_hash_table_contains(defined, GUINT_TO_POINTER(forward->callee))) {
+      summary_store_lookup(parser->summaries,
+                           node_table_ident_name(parser->nodes,
+                                                 forward->callee),
+                           &external[f]);
+    }
+  }
+
+  /* Only ever adds, so it ends */
+  do {
+    changed = FALSE;
+    for (guint i = 0; i < table->functions->len; i++) {
+      struct function_info *info;
+      const struct function_rename *renames;
+
+      info = &g_array_index(table->functions, struct function_info, i);
+      if (info->kind != FUNCTION_KIND_DEFINITION) {
+        continue;
+      }
+      renames = function_table_renames(table, info);
+      for (guint p = 0; p < info->n_params; p++) {
+        struct function_param *param = param_at(table, info, p);
+
+        for (guint f = info->forwards_start;
+             !param->asserted && param->name != 0 &&
+             f < info->forwards_start + info->n_forwards;
+             f++) {
+          const struct function_forward *forward;
+
+          forward = &g_array_index(table->forwards, struct function_forward,
+                                   f);
+          if (renamed_to_arg(renames, info->n_renames, param->name,
+                             forward->arg) &&
+              callee_asserts(b, defined, external, f)) {
+            param->asserted = TRUE;
+            changed = TRUE;
+          }
+        }
+      }
+    }
+  } while (changed);
+
+  g_free(external);
+  g_hash_table_unref(defined);
+}
+
+/* Shares the summaries of the functions other files can call, replacing
+ * those of the earlier versions of the file */
+static void
+publish_summaries(struct builder *b)
+{
+  function_table_t *table;
+  parser_t *parser;
+  GArray *functions;
+
+  g_assert(b);
+
+  table = b->table;
+  parser = b->parser;
+  if (parser->summaries == NULL || parser->file == NULL) {
+    return;
+  }
+
+  functions = g_array_new(FALSE, FALSE, sizeof(struct summary_store_function));
+  for (guint i = 0; i < table->functions->len; i++) {
+    const struct function_info *info;
+    struct summary_store_function function;
+
+    info = &g_array_index(table->functions, struct function_info, i);
+    if (info->kind != FUNCTION_KIND_DEFINITION || info->is_static ||
+        info->name == 0) {
+      continue;
+    }
+    function.name = node_table_ident_name(parser->nodes, info->name);
+    function.asserted = 0;
+    for (guint p = 0; p < MIN(info->n_params, SUMMARY_STORE_MAX_PARAMS);
+         p++) {
+      if (param_at(table, info, p)->asserted) {
+        function.asserted |= G_GUINT64_CONSTANT(1) << p;
+      }
+    }
+    g_array_append_val(functions, function);
+  }
+  summary_store_replace(parser->summaries, parser->file, parser->version,
+                        parser->cancellable,
+                        (const struct summary_store_function *)
+                          functions->data,
+                        functions->len);
+  g_array_unref(functions);
+}
+
+static gint
+compare_start(gconstpointer a, gconstpointer b)
+{
+  const struct function_info *fa = (const struct function_info *) a;
+  const struct function_info *fb = (const struct function_info *) b;
+
+  return (fa->start_byte > fb->start_byte) - (fa->start_byte < fb->start_byte);
+}
+
+function_table_t *
+function_table_new(parser_t *parser)
+{
+  function_table_t *table;
+  struct builder b;
+  const struct node_entry *entries;
+  const guint32 *definitions;
+  guint count;
+
+  g_assert(parser);
+
+  table = g_new0(function_table_t, 1);
+  table->functions = g_array_new(FALSE, FALSE, sizeof(struct function_info));
+  table->params = g_array_new(FALSE, FALSE, sizeof(struct function_param));
+  table->asserts = g_array_new(FALSE, FALSE, sizeof(guint32));
+  table->renames = g_array_new(FALSE, FALSE, sizeof(struct function_rename));
+  table->forwards = g_array_new(FALSE, FALSE,
+                                sizeof(struct function_forward));
+  table->comments = g_array_new(FALSE, FALSE, sizeof(struct function_comment));
+  table->comment_text = g_string_new(NULL);
+
+  if (parser->nodes == NULL) {
+    return table;
+  }
+
+  b.table = table;
+  b.parser = parser;
+  b.cursor = ts_tree_cursor_new(parser->root_node);
+  b.asserts = bitset_new();
+
+  /* Definitions wherever they are, preprocessor blocks included */
+  definitions = node_table_all(parser->nodes, 0, SYMBOL_FUNCTION, &count);
+  for (guint i = 0; i < count; i++) {
+    add_function(&b, definitions[i], FUNCTION_KIND_DEFINITION);
+  }
+
+  /* Prototypes at the top level */
+  entries = (const struct node_entry *) parser->nodes->entries->data;
+  for (guint32 child = 1; child < entries[0].end; child = entries[child].end) {
+    TSNode n;
+
+    if (entries[child].symbol != SYMBOL_DECLARATION) {
+      continue;
+    }
+    n = node_table_node(parser->nodes, child);
+    if (!ts_node_is_null(function_declarator(
+          ts_node_child_by_field_id(n, FIELD_DECLARATOR)))) {
+      add_function(&b, child, FUNCTION_KIND_PROTOTYPE);
+    }
+  }
+
+  ts_tree_cursor_delete(&b.cursor);
+  g_array_sort(table->functions, compare_start);
+
+  add_summaries(&b);
+  publish_summaries(&b);
+  bitset_free(b.asserts);
+
+  return table;
+}
+
+void
+function_table_free(function_table_t *table)
+{
+  if (table == NULL) {
+    return;
+  }
+  g_array_unref(table->functions);
+  g_array_unref(table->params);
+  g_array_unref(table->asserts);
+  g_array_unref(table->renames);
+  g_array_unref(table->forwards);
+  g_array_unref(table->comments);
+  g_string_free(table->comment_text, TRUE);
+  g_free(table);
+}
+
+/* Index of the first function starting at or after start */
+static guint
+first_at(const function_table_t *table, guint32 start)
+{
+  guint low = 0;
+  guint high = table->functions->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (g_array_index(table->functions, struct function_info, mid).start_byte <
+        start) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+const struct function_info *
+function_table_lookup(const function_table_t *table, TSNode n)
+{
+  guint32 start;
+  guint low;
+
+  g_assert(table);
+
+  start = ts_node_start_byte(n);
+  for (low = first_at(table, start); low < table->functions->len; low++) {
+    const struct function_info *info;
+
+    info = &g_array_index(table->functions, struct function_info, low);
+    if (info->start_byte != start) {
+      break;
+    }
+    if (ts_node_eq(info->node, n)) {
+      return info;
+    }
+  }
+  return NULL;
+}
+
+const struct function_param *
+function_table_params(const function_table_t *table,
+                      const struct function_info *info)
+{
+  g_assert(table);
+  g_assert(info);
+
+  return &g_array_index(table->params, struct function_param,
+                        info->params_start);
+}
+
+const guint32 *
+function_table_asserts(const function_table_t *table,
+                       const struct function_info *info)
+{
+  g_assert(table);
+  g_assert(info);
+
+  return &g_array_index(table->asserts, guint32, info->asserts_start);
+}
+
+const struct function_rename *
+function_table_renames(const function_table_t *table,
+                       const struct function_info *info)
+{
+  g_assert(table);
+  g_assert(info);
+
+  return &g_array_index(table->renames, struct function_rename,
+                        info->renames_start);
+}
+
+const struct function_forward *
+function_table_forwards(const function_table_t *table,
+                        const struct function_info *info)
+{
+  g_assert(table);
+  g_assert(info);
+
+  return &g_array_index(table->forwards, struct function_forward,
+                        info->forwards_start);
+}
+
+guint64
+function_table_summary_hash(const function_table_t *table,
+                            guint32 start_byte,
+                            guint32 end_byte)
+{
+  guint64 hash = 0;
+
+  g_assert(table);
+
+  for (guint i = first_at(table, start_byte); i < table->functions->len;
+       i++) {
+    const struct function_info *info;
+    const struct function_param *params;
+
+    info = &g_array_index(table->functions, struct function_info, i);
+    if (info->start_byte >= end_byte) {
+      break;
+    }
+    if (info->kind != FUNCTION_KIND_DEFINITION) {
+      continue;
+    }
+    params = function_table_params(table, info);
+    for (guint p = 0; p < info->n_params; p++) {
+      hash = (hash ^ (params[p].asserted + 1)) * SUMMARY_HASH_MUL;
+    }
+    /* Ends the parameters of the function */
+    hash = (hash ^ 3) * SUMMARY_HASH_MUL;
+  }
+  return hash;
+}
+
+const struct function_comment *
+function_table_comments(const function_table_t *table,
+                        const struct function_info *info)
+{
+  g_assert(table);
+  g_assert(info);
+
+  return &g_array_index(table->comments, struct function_comment,
+                        info->comments_start);
+}
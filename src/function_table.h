@@ -0,0 +1,144 @@
+#pragma once
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+#include "parser.h"
+
+G_BEGIN_DECLS
+
+/* Facts about the functions of a file that several rules need, worked out
+ * once per parse by parser_get_functions() and read only afterwards */
+typedef struct function_table function_table_t;
+
+enum function_kind {
+  FUNCTION_KIND_DEFINITION = 0,
+  /* Top level declaration of a function */
+  FUNCTION_KIND_PROTOTYPE,
+};
+
+struct function_param {
+  /* The parameter_declaration */
+  TSNode node;
+  /* First identifier of the parameter, null node if it has none */
+  TSNode ident;
+  /* Interned name of the pointer for pointers, of ident otherwise, 0 if
+   * there is none */
+  guint32 name;
+  gboolean pointer;
+  /* Marked G_GNUC_UNUSED */
+  gboolean unused;
+  /* A GError **err */
+  gboolean gerror;
+  /* For definitions: asserted by the function or by a function it passes
+   * the parameter to, directly or after renames and casts */
+  gboolean asserted;
+};
+
+/* from is cast or assigned to to, as interned names */
+struct function_rename {
+  guint32 from;
+  guint32 to;
+};
+
+/* arg, as interned name, is passed as argument index to callee */
+struct function_forward {
+  guint32 callee;
+  guint32 arg;
+  guint32 index;
+};
+
+/* A comment inside a function, lowercased in the comment text of the table */
+struct function_comment {
+  guint32 start;
+  guint32 len;
+  /* Mentions null in any case */
+  gboolean null;
+};
+
+/* The lists of a function are slices of the arrays of the table, so that
+ * building the table does not allocate per function */
+struct function_info {
+  TSNode node;
+  enum function_kind kind;
+  guint32 start_byte;
+  guint32 end_byte;
+  gboolean is_static;
+  /* Interned name, 0 if the declarator has none */
+  guint32 name;
+  /* The parameter_list, null node if the declarator has none */
+  TSNode param_list;
+  guint params_start;
+  guint n_params;
+  /* Comment right before the function, null node if there is none */
+  TSNode doc;
+  /* For definitions: ids of the asserted identifiers, renames by cast and
+   * identifiers passed to other functions */
+  guint asserts_start;
+  guint n_asserts;
+  guint renames_start;
+  guint n_renames;
+  guint forwards_start;
+  guint n_forwards;
+  /* For static definitions only: comments and whether err is checked like a
+   * GError should be */
+  guint comments_start;
+  guint n_comments;
+  gboolean gerror_checked;
+};
+
+struct function_table {
+  /* struct function_info by position in the file */
+  GArray *functions;
+  /* struct function_param of all functions */
+  GArray *params;
+  /* guint32 asserted identifier ids of all functions */
+  GArray *asserts;
+  /* struct function_rename of all functions */
+  GArray *renames;
+  /* struct function_forward of all functions */
+  GArray *forwards;
+  /* struct function_comment of all functions */
+  GArray *comments;
+  /* The lowercased comments, one after the other */
+  GString *comment_text;
+};
+
+function_table_t *function_table_new(parser_t *parser);
+
+void function_table_free(function_table_t *table);
+
+/* The function whose definition or prototype is n, NULL if n is neither */
+const struct function_info *function_table_lookup(const function_table_t *table,
+                                                  TSNode n);
+
+/* The n_params parameters of info */
+const struct function_param *
+function_table_params(const function_table_t *table,
+                      const struct function_info *info);
+
+/* The n_asserts asserted identifier ids of info */
+const guint32 *function_table_asserts(const function_table_t *table,
+                                      const struct function_info *info);
+
+/* The n_renames renames of info */
+const struct function_rename *
+function_table_renames(const function_table_t *table,
+                       const struct function_info *info);
+
+/* The n_forwards forwards of info */
+const struct function_forward *
+function_table_forwards(const function_table_t *table,
+                        const struct function_info *info);
+
+/* Fingerprint of the asserted parameters of the functions starting in
+ * [start_byte, end_byte), which depend on other functions */
+guint64 function_table_summary_hash(const function_table_t *table,
+                                    guint32 start_byte,
+                                    guint32 end_byte);
+
+/* The n_comments comments of info, their text is in comment_text */
+const struct function_comment *
+function_table_comments(const function_table_t *table,
+                        const struct function_info *info);
+
+G_END_DECLS
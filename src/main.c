@@ -14,6 +14,38 @@
 #include "process_asserts.h"
 #include "process_midscope.h"
 #include "process_comments.h"
+#include "process_queries.h"
+
+/* Overrides where the rules of the user are read from */
+#define RULES_ENV "GLIB_LSP_RULES"
+
+/* Loads the rules of the user, if there is a file for them. The client is
+ * told about errors by the rules process. */
+static gboolean
+load_queries(void)
+{
+  GError *err = NULL;
+  gchar *path;
+  gboolean res = FALSE;
+
+  if (g_getenv(RULES_ENV) != NULL) {
+    path = g_strdup(g_getenv(RULES_ENV));
+  } else {
+    path = g_build_filename(g_get_user_config_dir(), "glib-lsp", "rules.json",
+                            NULL);
+  }
+  if (!process_queries_load(path, &err)) {
+    g_warning("Could not load rules: %s", err->message);
+    g_clear_error(&err);
+    goto out;
+  }
+  res = process_queries_count() > 0;
+
+  /* Fall through */
+out:
+  g_free(path);
+  return res;
+}
 
 static void
 add_processors(processor_t *p)
@@ -25,11 +57,22 @@ add_processors(processor_t *p)
   ctx->name = "glib_lsp";
   ctx->version = "0.0.1";
   ctx->conf.sync = 1;
+  ctx->conf.save = TRUE;
   /* TODO: Check config before adding processors */
-  processor_add_process(p, process_init_do, ctx);
-  processor_add_process(p, process_asserts, ctx);
-  processor_add_process(p, process_midscope, ctx);
-  processor_add_process(p, process_comments, ctx);
+  processor_add_process(p, "init", process_init_do, PROCESS_TIER_CHEAP, ctx);
+  processor_add_process(p, "rules", process_queries_notices,
+                        PROCESS_TIER_CHEAP, ctx);
+  processor_add_rule(p, "asserts", process_asserts_register,
+                     PROCESS_TIER_EXPENSIVE);
+  processor_add_rule(p, "midscope", process_midscope_register,
+                     PROCESS_TIER_CHEAP);
+  processor_add_rule(p, "comments", process_comments_register,
+                     PROCESS_TIER_EXPENSIVE);
+  /* Matched in the same query pass as the built in rules */
+  if (load_queries()) {
+    processor_add_rule(p, "queries", process_queries_register,
+                       PROCESS_TIER_CHEAP);
+  }
 }
 
 int
@@ -54,6 +97,12 @@ main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
   }
 
   add_processors(processor);
+  if (!processor_compile(processor, &err)) {
+    g_warning("Could not start: %s", err->message);
+    g_clear_error(&err);
+    ret_val = 1;
+    goto out;
+  }
 
   in = g_data_input_stream_new(stdinput);
 
@@ -70,7 +119,6 @@ main(G_GNUC_UNUSED int argc, G_GNUC_UNUSED char *argv[])
     if (!processor_handle_message(processor, msg, &err)) {
       g_warning("Error processing message: %s", err->message);
       g_clear_error(&err);
-      message_free(msg);
     }
   }
   g_clear_object(&in);
@@ -3,6 +3,7 @@
 #include <tree_sitter/api.h>
 
 #include "message.h"
+#include "rules.h"
 
 #define INITIALIZE  "initialize"
 #define INITIALIZED "initialized"
@@ -10,6 +11,8 @@
 #define DIDCHANGE   "textDocument/didChange"
 #define DIDSAVE     "textDocument/didSave"
 #define DIAGNOSTIC  "textDocument/diagnostic"
+#define CANCEL      "$/cancelRequest"
+#define DIDCHANGECONFIGURATION "workspace/didChangeConfiguration"
 
 static gchar *
 get_string_from_json_object(JsonObject *object)
@@ -88,6 +91,32 @@ parse_document(JsonObject *params, struct document_change *d)
   return TRUE;
 }
 
+static void
+parse_init_options(JsonObject *params, message_t *msg)
+{
+  JsonObject *options;
+
+  g_assert(params);
+  g_assert(msg);
+
+  if (!json_object_has_member(params, "initializationOptions")) {
+    return;
+  }
+  options = json_object_get_object_member(params, "initializationOptions");
+  if (options == NULL) {
+    return;
+  }
+
+  if (json_object_has_member(options, "minWorkers")) {
+    msg->data.init.min_workers = json_object_get_int_member(options,
+                                                            "minWorkers");
+  }
+  if (json_object_has_member(options, "maxWorkers")) {
+    msg->data.init.max_workers = json_object_get_int_member(options,
+                                                            "maxWorkers");
+  }
+}
+
 static message_t *
 parse_request(JsonObject *root, GError **err)
 {
@@ -114,6 +143,7 @@ parse_request(JsonObject *root, GError **err)
       json_object_get_string_member(client, "name"));
     msg->data.init.client_version = g_strdup(
       json_object_get_string_member(client, "version"));
+    parse_init_options(params, msg);
     return msg;
   }
   if (g_strcmp0(method, DIAGNOSTIC) == 0) {
@@ -165,6 +195,39 @@ parse_notification(JsonObject *root, GError **err)
     parse_document(params, &msg->data.change);
     return msg;
   }
+  if (g_strcmp0(method, DIDSAVE) == 0) {
+    params = json_object_get_object_member(root, "params");
+    msg = g_malloc0(sizeof(*msg));
+    msg->type = MESSAGE_TYPE_SAVE;
+    parse_document(params, &msg->data.save);
+    return msg;
+  }
+  if (g_strcmp0(method, CANCEL) == 0) {
+    JsonNode *id = NULL;
+
+    params = json_object_get_object_member(root, "params");
+    if (params != NULL) {
+      id = json_object_get_member(params, "id");
+    }
+    /* Requests are only known by integer ids, a string id would otherwise
+     * be read as 0 and cancel that request */
+    if (id == NULL || !JSON_NODE_HOLDS_VALUE(id) ||
+        json_node_get_value_type(id) != G_TYPE_INT64) {
+      g_set_error(err, MESSAGE_ERROR, -1,
+                  "Ignoring cancel of a request without an integer id");
+      return NULL;
+    }
+    msg = g_malloc0(sizeof(*msg));
+    msg->type = MESSAGE_TYPE_CANCEL;
+    msg->data.cancel.id = json_node_get_int(id);
+    return msg;
+  }
+  if (g_strcmp0(method, DIDCHANGECONFIGURATION) == 0) {
+    /* The settings themselves are not used */
+    msg = g_malloc0(sizeof(*msg));
+    msg->type = MESSAGE_TYPE_CONFIGURATION;
+    return msg;
+  }
 
   g_set_error(err, MESSAGE_ERROR, -1, "Invalid notification method: %s", method);
 
@@ -255,84 +318,45 @@ range_to_json(struct range *r)
 
   return root;
 }
-struct problem *
-message_problem_new_pos(gint severity,
-                        guint64 start_line,
-                        guint64 start_char,
-                        guint64 end_line,
-                        guint64 end_char,
-                        const gchar *format,
-                        ...)
-{
-  struct problem *p;
-  va_list args;
-
-  p = g_malloc0(sizeof(*p));
-  va_start(args, format);
-  p->msg = g_strdup_vprintf(format, args);
-  va_end(args);
-
-  p->range.start.line = start_line;
-  p->range.start.character = start_char;
-  p->range.end.line = end_line;
-  p->range.end.character = end_char;
-  p->severity = severity;
-
-  return p;
-}
-
-struct problem *
-message_problem_new(gint severity,
-                    TSNode *start_node,
-                    TSNode *end_node,
-                    const gchar *format,
-                    ...)
-{
-  struct problem *p;
-  va_list args;
-  TSPoint start = ts_node_start_point(*start_node);
-  TSPoint end = ts_node_end_point(*end_node);
-
-  p = g_malloc0(sizeof(*p));
-  va_start(args, format);
-  p->msg = g_strdup_vprintf(format, args);
-  va_end(args);
-
-  p->range.start.line = start.row;
-  p->range.start.character = start.column;
-  p->range.end.line = end.row;
-  p->range.end.character = end.column;
-  p->severity = severity;
-
-  return p;
-}
-
 static JsonArray *
-diagnostics_to_json(GList *issues)
+diagnostics_to_json(const problems_t *issues)
 {
   JsonArray *dia;
+  GString *text;
+
   dia = json_array_new();
+  text = g_string_new(NULL);
 
-  while (issues != NULL) {
-    struct problem *p = (struct problem *) issues->data;
-    JsonObject *range;
+  for (guint i = 0; i < problems_len(issues); i++) {
+    const struct problem *p = problems_get(issues, i);
+    const struct rule_info *rule = rules_get(p->id);
+    struct range r;
     JsonObject *d;
 
-    range = range_to_json(&p->range);
+    r.start.line = p->start_line;
+    r.start.character = p->start_char;
+    r.end.line = p->end_line;
+    r.end.character = p->end_char;
     d = json_object_new();
 
-    json_object_set_object_member(d, "range", range);
-    json_object_set_int_member(d, "severity", p->severity);
-    json_object_set_string_member(d, "message", p->msg);
+    json_object_set_object_member(d, "range", range_to_json(&r));
+    json_object_set_int_member(d, "severity", rule->severity);
+    json_object_set_string_member(d, "code", rule->code);
+    json_object_set_string_member(d, "source", RULES_SOURCE);
+    /* Messages are only formatted here */
+    g_string_truncate(text, 0);
+    problems_format(issues, p, text);
+    json_object_set_string_member(d, "message", text->str);
 
     json_array_add_object_element(dia, d);
-    issues = issues->next;
   }
+  g_string_free(text, TRUE);
+
   return dia;
 }
 
 gchar *
-message_diagnostic(gint64 id, const gchar *uri, GList *issues)
+message_diagnostic(gint64 id, const gchar *uri, const problems_t *issues)
 {
   JsonObject *root;
   JsonObject *params;
@@ -364,6 +388,54 @@ message_diagnostic(gint64 id, const gchar *uri, GList *issues)
   return res;
 }
 
+gchar *
+message_error_response(gint64 id, gint code, const gchar *text)
+{
+  JsonObject *root;
+  JsonObject *error;
+  gchar *res;
+
+  g_return_val_if_fail(text != NULL, NULL);
+
+  root = get_response_root(id);
+  error = json_object_new();
+
+  json_object_set_int_member(error, "code", code);
+  json_object_set_string_member(error, "message", text);
+  json_object_set_object_member(root, "error", error);
+
+  res = get_string_from_json_object(root);
+
+  json_object_unref(root);
+
+  return res;
+}
+
+gchar *
+message_show(gint type, const gchar *text)
+{
+  JsonObject *root;
+  JsonObject *params;
+  gchar *res;
+
+  g_return_val_if_fail(text != NULL, NULL);
+
+  root = json_object_new();
+  params = json_object_new();
+
+  json_object_set_string_member(root, "jsonrpc", "2.0");
+  json_object_set_string_member(root, "method", "window/showMessage");
+  json_object_set_int_member(params, "type", type);
+  json_object_set_string_member(params, "message", text);
+  json_object_set_object_member(root, "params", params);
+
+  res = get_string_from_json_object(root);
+
+  json_object_unref(root);
+
+  return res;
+}
+
 gchar *
 message_init_response(gint64 id,
                       struct init_config *c,
@@ -374,6 +446,7 @@ message_init_response(gint64 id,
   JsonObject *result;
   JsonObject *server_info;
   JsonObject *capabilities;
+  JsonObject *sync;
   JsonObject *code_action;
   JsonArray *kinds;
   gchar *res;
@@ -388,7 +461,17 @@ message_init_response(gint64 id,
   json_object_set_string_member(server_info, "name", server_name);
   json_object_set_string_member(server_info, "version", version);
 
-  json_object_set_int_member(capabilities, "textDocumentSync", c->sync);
+  sync = json_object_new();
+  json_object_set_boolean_member(sync, "openClose", TRUE);
+  json_object_set_int_member(sync, "change", c->sync);
+  if (c->save) {
+    JsonObject *save;
+
+    save = json_object_new();
+    json_object_set_boolean_member(save, "includeText", FALSE);
+    json_object_set_object_member(sync, "save", save);
+  }
+  json_object_set_object_member(capabilities, "textDocumentSync", sync);
   json_object_set_string_member(capabilities, "workspaceFolders", "utf-16");
 
   code_action = json_object_new();
@@ -456,20 +539,16 @@ message_free(message_t *msg)
     g_free(msg->data.diagnostic.document.text);
     break;
   case MESSAGE_TYPE_SAVE:
+    g_free(msg->data.save.language);
+    g_free(msg->data.save.uri);
+    g_free(msg->data.save.text);
+    break;
+  case MESSAGE_TYPE_CANCEL:
+  case MESSAGE_TYPE_CONFIGURATION:
     /* ignore */
+    break;
   }
-}
-
-void
-message_problem_free(gpointer p)
-{
-  struct problem *ctx = (struct problem *) p;
-  if (p == NULL) {
-    return;
-  }
-
-  g_free(ctx->msg);
-  g_free(p);
+  g_free(msg);
 }
 
 G_DEFINE_QUARK("message-error-quark", message_error)
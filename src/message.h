@@ -5,6 +5,8 @@
 #include <tree_sitter/api.h>
 #include "glibconfig.h"
 
+#include "problems.h"
+
 G_BEGIN_DECLS
 
 enum message_type {
@@ -13,12 +15,23 @@ enum message_type {
   MESSAGE_TYPE_OPEN,
   MESSAGE_TYPE_CHANGE,
   MESSAGE_TYPE_DIAGNOSTIC,
-  MESSAGE_TYPE_SAVE
+  MESSAGE_TYPE_SAVE,
+  MESSAGE_TYPE_CANCEL,
+  MESSAGE_TYPE_CONFIGURATION
 };
 #define MESSAGE_ERROR message_error_quark()
 
+/* LSP error codes */
+#define MESSAGE_REQUEST_CANCELLED -32800
+
+/* LSP message types of window/showMessage */
+#define MESSAGE_SHOW_ERROR 1
+#define MESSAGE_SHOW_INFO  3
+
 struct init_config {
   gint64 sync;
+  /* Ask for didSave notifications */
+  gboolean save;
   gboolean hover;
   gboolean definition;
   gboolean codeaction;
@@ -43,12 +56,6 @@ struct range {
   } end;
 };
 
-struct problem {
-  struct range range;
-  gint severity;
-  gchar *msg;
-};
-
 typedef struct message {
   enum message_type type;
   union {
@@ -56,37 +63,35 @@ typedef struct message {
       gint64 id;
       gchar *client_name;
       gchar *client_version;
+      /* From initializationOptions, 0 when not set */
+      gint64 min_workers;
+      gint64 max_workers;
     } init;
 
     struct document_change open;
     struct document_change change;
+    struct document_change save;
 
     struct {
       gint64 id;
       struct document_change document;
       struct range range;
     } diagnostic;
+
+    struct {
+      gint64 id;
+    } cancel;
   } data;
 } message_t;
 
-struct problem *message_problem_new(gint severity,
-                                    TSNode *start,
-                                    TSNode *end,
-                                    const gchar *format,
-                                    ...);
-struct problem *message_problem_new_pos(gint severity,
-                                        guint64 start_line,
-                                        guint64 start_char,
-                                        guint64 end_line,
-                                        guint64 end_char,
-                                        const gchar *format,
-                                        ...);
-
-void message_problem_free(gpointer p);
-
 message_t *message_parse(const gchar *json, gsize len, GError **err);
 
-gchar *message_diagnostic(gint64 id, const gchar *uri, GList *issues);
+gchar *message_diagnostic(gint64 id,
+                          const gchar *uri,
+                          const problems_t *issues);
+gchar *message_error_response(gint64 id, gint code, const gchar *text);
+/* A window/showMessage notification, type is one of MESSAGE_SHOW_* */
+gchar *message_show(gint type, const gchar *text);
 gchar *message_init_response(gint64 id,
                              struct init_config *c,
                              const gchar *server_name,
@@ -0,0 +1,388 @@
+#include <glib.h>
+#include <string.h>
+#include <tree_sitter/api.h>
+
+#include "node_table.h"
+#include "parse_utils.h"
+
+#define ENTRY(table, i) g_array_index((table)->entries, struct node_entry, (i))
+
+/* Size of the first block of names */
+#define NAMES_BLOCK 1024
+
+static void
+add_posting(node_table_t *table, TSSymbol symbol, guint32 index)
+{
+  GArray *postings;
+
+  g_assert(table);
+
+  if (symbol >= table->postings->len) {
+    g_ptr_array_set_size(table->postings, symbol + 1);
+  }
+  postings = g_ptr_array_index(table->postings, symbol);
+  if (postings == NULL) {
+    postings = g_array_new(FALSE, FALSE, sizeof(guint32));
+    table->postings->pdata[symbol] = postings;
+  }
+  g_array_append_val(postings, index);
+}
+
+/* A nul terminated copy of the len bytes of text in the blocks, so that
+ * interning allocates once per doubling of the names and not per name */
+static gchar *
+copy_name(node_table_t *table, const gchar *text, gsize len)
+{
+  gchar *res;
+
+  g_assert(table);
+  g_assert(text);
+
+  if (table->blocks->len == 0 ||
+      table->block_used + len + 1 > table->block_size) {
+    table->block_size = MAX(MAX(table->block_size * 2, NAMES_BLOCK), len + 1);
+    table->block_used = 0;
+    g_ptr_array_add(table->blocks, g_malloc(table->block_size));
+  }
+  res = (gchar *) g_ptr_array_index(table->blocks, table->blocks->len - 1) +
+        table->block_used;
+  memcpy(res, text, len);
+  res[len] = '\0';
+  table->block_used += len + 1;
+
+  return res;
+}
+
+/* Id of the text of n, buf only avoids copying names seen before */
+static guint32
+intern(node_table_t *table, const gchar *content, GString *buf, TSNode n)
+{
+  gpointer id;
+  guint32 start = ts_node_start_byte(n);
+
+  g_assert(table);
+  g_assert(content);
+  g_assert(buf);
+
+  g_string_truncate(buf, 0);
+  g_string_append_len(buf, content + start, ts_node_end_byte(n) - start);
+
+  id = g_hash_table_lookup(table->ids, buf->str);
+  if (id == NULL) {
+    gchar *name = copy_name(table, buf->str, buf->len);
+
+    id = GUINT_TO_POINTER(table->names->len);
+    g_ptr_array_add(table->names, name);
+    g_hash_table_insert(table->ids, name, id);
+  }
+  return GPOINTER_TO_UINT(id);
+}
+
+/* Adds the node under the cursor and its subtree, leaving the cursor on it.
+ * Returns the index of the node. */
+static gint32
+add_subtree(node_table_t *table,
+            const gchar *content,
+            GString *buf,
+            TSTreeCursor *cursor,
+            gint32 parent,
+            gint32 prev)
+{
+  TSNode n;
+  struct node_entry entry;
+  gint32 index;
+  guint32 ident = 0;
+
+  g_assert(table);
+  g_assert(content);
+  g_assert(cursor);
+
+  n = ts_tree_cursor_current_node(cursor);
+  index = table->entries->len;
+
+  entry.symbol = ts_node_symbol(n);
+  entry.start_byte = ts_node_start_byte(n);
+  entry.end_byte = ts_node_end_byte(n);
+  entry.parent = parent;
+  entry.prev = prev;
+  entry.end = 0;
+  g_array_append_val(table->entries, entry);
+  g_array_append_val(table->nodes, n);
+  add_posting(table, entry.symbol, index);
+
+  if (entry.symbol == SYMBOL_IDENTIFIER) {
+    ident = intern(table, content, buf, n);
+  }
+  g_array_append_val(table->idents, ident);
+
+  if (parse_utils_cursor_first_named_child(cursor)) {
+    gint32 child = -1;
+
+    do {
+      child = add_subtree(table, content, buf, cursor, index, child);
+    } while (parse_utils_cursor_next_named_sibling(cursor));
+    ts_tree_cursor_goto_parent(cursor);
+  }
+
+  ENTRY(table, index).end = table->entries->len;
+
+  return index;
+}
+
+node_table_t *
+node_table_new(TSNode root, const gchar *content)
+{
+  node_table_t *table;
+  TSTreeCursor cursor;
+  GString *buf;
+
+  g_assert(content);
+
+  table = g_new0(node_table_t, 1);
+  table->entries = g_array_new(FALSE, FALSE, sizeof(struct node_entry));
+  table->nodes = g_array_new(FALSE, FALSE, sizeof(TSNode));
+  table->postings = g_ptr_array_new();
+  table->idents = g_array_new(FALSE, FALSE, sizeof(guint32));
+  table->ids = g_hash_table_new(g_str_hash, g_str_equal);
+  table->names = g_ptr_array_new();
+  table->blocks = g_ptr_array_new_with_free_func(g_free);
+  /* Id 0 is no identifier */
+  g_ptr_array_add(table->names, NULL);
+
+  buf = g_string_new(NULL);
+  cursor = ts_tree_cursor_new(root);
+  add_subtree(table, content, buf, &cursor, -1, -1);
+  ts_tree_cursor_delete(&cursor);
+  g_string_free(buf, TRUE);
+
+  return table;
+}
+
+void
+node_table_free(node_table_t *table)
+{
+  if (table == NULL) {
+    return;
+  }
+  for (guint i = 0; i < table->postings->len; i++) {
+    GArray *postings = g_ptr_array_index(table->postings, i);
+
+    if (postings != NULL) {
+      g_array_unref(postings);
+    }
+  }
+  g_ptr_array_unref(table->postings);
+  g_array_unref(table->entries);
+  g_array_unref(table->nodes);
+  g_array_unref(table->idents);
+  g_hash_table_unref(table->ids);
+  g_ptr_array_unref(table->names);
+  g_ptr_array_unref(table->blocks);
+  g_free(table);
+}
+
+TSNode
+node_table_node(const node_table_t *table, guint index)
+{
+  g_assert(table);
+  g_assert(index < table->nodes->len);
+
+  return g_array_index(table->nodes, TSNode, index);
+}
+
+guint32
+node_table_ident(const node_table_t *table, TSNode n)
+{
+  gint index;
+
+  g_assert(table);
+
+  if (ts_node_is_null(n)) {
+    return 0;
+  }
+  index = node_table_index(table, n);
+  if (index < 0) {
+    return 0;
+  }
+  return g_array_index(table->idents, guint32, index);
+}
+
+const gchar *
+node_table_ident_name(const node_table_t *table, guint32 id)
+{
+  g_assert(table);
+  g_assert(id < table->names->len);
+
+  return g_ptr_array_index(table->names, id);
+}
+
+guint32
+node_table_ident_count(const node_table_t *table)
+{
+  g_assert(table);
+
+  return table->names->len;
+}
+
+gint
+node_table_first_child(const node_table_t *table, guint index)
+{
+  g_assert(table);
+  g_assert(index < table->entries->len);
+
+  if (index + 1 >= ENTRY(table, index).end) {
+    return -1;
+  }
+  return index + 1;
+}
+
+gint
+node_table_next_sibling(const node_table_t *table, guint index)
+{
+  gint32 parent;
+
+  g_assert(table);
+  g_assert(index < table->entries->len);
+
+  parent = ENTRY(table, index).parent;
+  if (parent < 0 || ENTRY(table, index).end >= ENTRY(table, parent).end) {
+    return -1;
+  }
+  return ENTRY(table, index).end;
+}
+
+/* First position in postings holding an index >= value */
+static guint
+lower_bound(GArray *postings, guint32 value)
+{
+  guint low = 0;
+  guint high = postings->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (g_array_index(postings, guint32, mid) < value) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+gint
+node_table_index(const node_table_t *table, TSNode n)
+{
+  guint32 start;
+  guint low = 0;
+  guint high;
+
+  g_assert(table);
+
+  start = ts_node_start_byte(n);
+  high = table->entries->len;
+
+  /* Preorder keeps start bytes sorted, only ancestors share one */
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (ENTRY(table, mid).start_byte < start) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  for (; low < table->entries->len && ENTRY(table, low).start_byte == start;
+       low++) {
+    if (ts_node_eq(node_table_node(table, low), n)) {
+      return low;
+    }
+  }
+  return -1;
+}
+
+const guint32 *
+node_table_all(const node_table_t *table,
+               guint index,
+               TSSymbol symbol,
+               guint *count)
+{
+  GArray *postings = NULL;
+  guint first;
+  guint last;
+
+  g_assert(table);
+  g_assert(count);
+  g_assert(index < table->entries->len);
+
+  *count = 0;
+  if (symbol < table->postings->len) {
+    postings = g_ptr_array_index(table->postings, symbol);
+  }
+  if (postings == NULL) {
+    return NULL;
+  }
+
+  first = lower_bound(postings, index + 1);
+  last = lower_bound(postings, ENTRY(table, index).end);
+  *count = last - first;
+
+  return &g_array_index(postings, guint32, first);
+}
+
+static gint
+first_below(const node_table_t *table, guint32 index, TSSymbol symbol)
+{
+  const guint32 *all;
+  guint32 child;
+  guint count;
+
+  all = node_table_all(table, index, symbol, &count);
+  if (count == 0) {
+    return -1;
+  }
+
+  /* A named child of the symbol wins over deeper nodes */
+  for (child = index + 1; child < ENTRY(table, index).end;
+       child = ENTRY(table, child).end) {
+    if (ENTRY(table, child).symbol == symbol) {
+      return child;
+    }
+  }
+
+  /* Otherwise search the first child having one in its subtree */
+  child = all[0];
+  while ((guint32) ENTRY(table, child).parent != index) {
+    child = ENTRY(table, child).parent;
+  }
+  return first_below(table, child, symbol);
+}
+
+TSNode
+node_table_first(const node_table_t *table,
+                 TSNode check,
+                 TSSymbol symbol,
+                 gboolean *found)
+{
+  gint index;
+  gint res = -1;
+
+  g_assert(table);
+
+  if (ts_node_is_null(check)) {
+    goto out;
+  }
+  index = node_table_index(table, check);
+  if (index < 0) {
+    /* Not a node of this tree */
+    return parse_utils_get_first_node_id(check, symbol, found);
+  }
+  res = first_below(table, index, symbol);
+
+  /* Fall through */
+out:
+  if (found) {
+    *found = res >= 0;
+  }
+  return res >= 0 ? node_table_node(table, res) : check;
+}
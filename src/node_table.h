@@ -0,0 +1,83 @@
+#pragma once
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+G_BEGIN_DECLS
+
+/* The named nodes of a tree in preorder, built once per parse. The subtree
+ * of the node at i is [i + 1, end), so descendant searches are binary
+ * searches over the per-symbol postings.
+ *
+ * The identifiers are interned on the way: equal names share a 32 bit id, so
+ * rules compare and collect ids instead of strings. */
+typedef struct node_table node_table_t;
+
+struct node_entry {
+  TSSymbol symbol;
+  guint32 start_byte;
+  guint32 end_byte;
+  /* Index of the named parent, -1 for the root */
+  gint32 parent;
+  /* Index of the previous named sibling, -1 for first children */
+  gint32 prev;
+  /* Index after the last node of the subtree */
+  guint32 end;
+};
+
+struct node_table {
+  /* struct node_entry in preorder */
+  GArray *entries;
+  /* TSNode, indexed like entries */
+  GArray *nodes;
+  /* GArray of guint32 entry indexes by symbol, NULL for absent symbols */
+  GPtrArray *postings;
+  /* guint32 identifier id, indexed like entries, 0 for other nodes */
+  GArray *idents;
+  /* Name -> id, the names are owned by blocks */
+  GHashTable *ids;
+  /* Names by id, NULL for id 0, they point into blocks */
+  GPtrArray *names;
+  /* Blocks the names are copied to, each twice the size of the one before,
+   * and the bytes taken of the last */
+  GPtrArray *blocks;
+  gsize block_size;
+  gsize block_used;
+};
+
+node_table_t *node_table_new(TSNode root, const gchar *content);
+
+void node_table_free(node_table_t *table);
+
+/* Index of n in the table, -1 if it is not there */
+gint node_table_index(const node_table_t *table, TSNode n);
+
+/* Searches like parse_utils_get_first_node_id(): the named children of check
+ * first, then their subtrees in order. Returns check when nothing is found. */
+TSNode node_table_first(const node_table_t *table,
+                        TSNode check,
+                        TSSymbol symbol,
+                        gboolean *found);
+
+/* Indexes of all nodes of symbol below the node at index, in preorder */
+const guint32 *node_table_all(const node_table_t *table,
+                              guint index,
+                              TSSymbol symbol,
+                              guint *count);
+
+TSNode node_table_node(const node_table_t *table, guint index);
+
+/* Index of the first named child of the node at index, -1 if it has none */
+gint node_table_first_child(const node_table_t *table, guint index);
+
+/* Index of the next named sibling of the node at index, -1 for the last */
+gint node_table_next_sibling(const node_table_t *table, guint index);
+
+/* Id of the identifier n, 0 if n is not an identifier of this tree */
+guint32 node_table_ident(const node_table_t *table, TSNode n);
+
+const gchar *node_table_ident_name(const node_table_t *table, guint32 id);
+
+/* One more than the largest id */
+guint32 node_table_ident_count(const node_table_t *table);
+
+G_END_DECLS
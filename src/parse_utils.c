@@ -3,30 +3,151 @@
 
 #include "parse_utils.h"
 
-TSNode
-parse_utils_get_first_node_id(TSNode check, guint id, gboolean *found)
+const TSLanguage *tree_sitter_c(void);
+
+struct parse_utils_symbols parse_utils_symbols;
+struct parse_utils_fields parse_utils_fields;
+
+static TSSymbol
+resolve_symbol(const TSLanguage *language, const gchar *name)
 {
-  for (guint i = 0; i < ts_node_named_child_count(check); i++) {
-    TSNode n = ts_node_named_child(check, i);
-    if (ts_node_symbol(n) == id) {
-      if (found) {
-        *found = TRUE;
-      }
-      return n;
+  TSSymbol symbol;
+
+  symbol = ts_language_symbol_for_name(language, name, strlen(name), TRUE);
+  if (symbol == 0) {
+    g_error("tree-sitter-c has no node type %s", name);
+  }
+  return symbol;
+}
+
+static TSFieldId
+resolve_field(const TSLanguage *language, const gchar *name)
+{
+  TSFieldId field;
+
+  field = ts_language_field_id_for_name(language, name, strlen(name));
+  if (field == 0) {
+    g_error("tree-sitter-c has no field %s", name);
+  }
+  return field;
+}
+
+void
+parse_utils_init(void)
+{
+  static gsize resolved = 0;
+  const TSLanguage *c;
+
+  if (!g_once_init_enter(&resolved)) {
+    return;
+  }
+  c = tree_sitter_c();
+
+  parse_utils_symbols.identifier = resolve_symbol(c, "identifier");
+  parse_utils_symbols.comment = resolve_symbol(c, "comment");
+  parse_utils_symbols.function = resolve_symbol(c, "function_definition");
+  parse_utils_symbols.declaration = resolve_symbol(c, "declaration");
+  parse_utils_symbols.pointer_declaration =
+    resolve_symbol(c, "pointer_declarator");
+  parse_utils_symbols.func_declaration =
+    resolve_symbol(c, "function_declarator");
+  parse_utils_symbols.storage_spec =
+    resolve_symbol(c, "storage_class_specifier");
+  parse_utils_symbols.field_decl = resolve_symbol(c, "field_declaration");
+  parse_utils_symbols.param_declaration =
+    resolve_symbol(c, "parameter_declaration");
+  parse_utils_symbols.cast_expression = resolve_symbol(c, "cast_expression");
+  parse_utils_symbols.call_expression = resolve_symbol(c, "call_expression");
+  parse_utils_symbols.arg_list = resolve_symbol(c, "argument_list");
+  parse_utils_symbols.field_ident = resolve_symbol(c, "field_identifier");
+  parse_utils_symbols.type = resolve_symbol(c, "type_identifier");
+
+  parse_utils_fields.arguments = resolve_field(c, "arguments");
+  parse_utils_fields.declarator = resolve_field(c, "declarator");
+  parse_utils_fields.function = resolve_field(c, "function");
+  parse_utils_fields.parameters = resolve_field(c, "parameters");
+  parse_utils_fields.type = resolve_field(c, "type");
+
+  g_once_init_leave(&resolved, 1);
+}
+
+gboolean
+parse_utils_cursor_first_named_child(TSTreeCursor *cursor)
+{
+  g_assert(cursor);
+
+  if (!ts_tree_cursor_goto_first_child(cursor)) {
+    return FALSE;
+  }
+  while (!ts_node_is_named(ts_tree_cursor_current_node(cursor))) {
+    if (!ts_tree_cursor_goto_next_sibling(cursor)) {
+      ts_tree_cursor_goto_parent(cursor);
+      return FALSE;
     }
   }
-  for (guint i = 0; i < ts_node_named_child_count(check); i++) {
-    TSNode n = ts_node_named_child(check, i);
-    n = parse_utils_get_first_node_id(n, id, found);
-    if (ts_node_symbol(n) == id) {
-      /* Found already set */
-      return n;
+  return TRUE;
+}
+
+gboolean
+parse_utils_cursor_next_named_sibling(TSTreeCursor *cursor)
+{
+  g_assert(cursor);
+
+  while (ts_tree_cursor_goto_next_sibling(cursor)) {
+    if (ts_node_is_named(ts_tree_cursor_current_node(cursor))) {
+      return TRUE;
     }
   }
+  return FALSE;
+}
+
+/* Direct children first, then the subtrees of the children in order */
+static gboolean
+find_first_node_id(TSTreeCursor *cursor, guint id, TSNode *res)
+{
+  gboolean found = FALSE;
+
+  g_assert(cursor);
+  g_assert(res);
+
+  if (!parse_utils_cursor_first_named_child(cursor)) {
+    return FALSE;
+  }
+  do {
+    *res = ts_tree_cursor_current_node(cursor);
+    found = ts_node_symbol(*res) == id;
+  } while (!found && parse_utils_cursor_next_named_sibling(cursor));
+  ts_tree_cursor_goto_parent(cursor);
+
+  if (found) {
+    return TRUE;
+  }
+
+  parse_utils_cursor_first_named_child(cursor);
+  do {
+    found = find_first_node_id(cursor, id, res);
+  } while (!found && parse_utils_cursor_next_named_sibling(cursor));
+  ts_tree_cursor_goto_parent(cursor);
+
+  return found;
+}
+
+TSNode
+parse_utils_get_first_node_id(TSNode check, guint id, gboolean *found)
+{
+  TSTreeCursor cursor;
+  TSNode res;
+  gboolean ok = FALSE;
+
+  if (!ts_node_is_null(check)) {
+    cursor = ts_tree_cursor_new(check);
+    ok = find_first_node_id(&cursor, id, &res);
+    ts_tree_cursor_delete(&cursor);
+  }
   if (found) {
-    *found = FALSE;
+    *found = ok;
   }
-  return check;
+  return ok ? res : check;
 }
 
 gboolean
@@ -51,91 +172,109 @@ parse_utils_node_get_string(const gchar *content, TSNode *node)
   return g_strndup(content + start, len);
 }
 
+/* Whether the cast macro func, like MY_TYPE, is the one of type, like
+ * MyType: equal ignoring case and the underscores of func */
+static gboolean
+cast_matches_type(const gchar *content, TSNode func, TSNode type)
+{
+  const gchar *f = content + ts_node_start_byte(func);
+  const gchar *f_end = content + ts_node_end_byte(func);
+  const gchar *t = content + ts_node_start_byte(type);
+  const gchar *t_end = content + ts_node_end_byte(type);
+
+  g_assert(content);
+
+  for (; f < f_end; f++) {
+    if (*f == '_') {
+      continue;
+    }
+    if (t == t_end || g_ascii_toupper(*f) != g_ascii_toupper(*t)) {
+      return FALSE;
+    }
+    t++;
+  }
+  return t == t_end;
+}
+
 gboolean
 parse_utils_is_gobject_cast(const gchar *content,
-                             TSNode decl,
-                             gchar **to,
-                             gchar **from)
+                            const node_table_t *nodes,
+                            TSNode decl,
+                            TSNode *to,
+                            TSNode *from)
 {
-  gchar *func_name;
-  GString *func_name_upper;
-  gchar *type_name;
-  gchar *type_name_upper;
-
   gboolean found;
-  TSNode type = parse_utils_get_first_node_id(decl, SYMBOL_TYPE, &found);
+
+  g_assert(content);
+  g_assert(to);
+  g_assert(from);
+
+  TSNode type = node_table_first(nodes, decl, SYMBOL_TYPE, &found);
   if (!found) {
     return FALSE;
   }
-  TSNode pdecl = parse_utils_get_first_node_id(decl, SYMBOL_POINTER_DECLARATION,
-                                                &found);
+  TSNode pdecl = node_table_first(nodes, decl, SYMBOL_POINTER_DECLARATION,
+                                  &found);
   if (!found) {
     return FALSE;
   }
 
-  TSNode call_node = parse_utils_get_first_node_id(decl, SYMBOL_CALL_EXPRESSION,
-                                                    &found);
+  TSNode call_node = node_table_first(nodes, decl, SYMBOL_CALL_EXPRESSION,
+                                      &found);
 
   if (!found) {
     return FALSE;
   }
 
-  TSNode to_node = parse_utils_get_first_node_id(pdecl, SYMBOL_IDENTIFIER,
-                                                  &found);
+  TSNode to_node = node_table_first(nodes, pdecl, SYMBOL_IDENTIFIER, &found);
   if (!found) {
     return FALSE;
   }
-  TSNode func_name_node = parse_utils_get_first_node_id(call_node,
-                                                         SYMBOL_IDENTIFIER,
-                                                         &found);
+  TSNode func_name_node = node_table_first(nodes, call_node,
+                                           SYMBOL_IDENTIFIER, &found);
   if (!found) {
     return FALSE;
   }
-  TSNode args_node = parse_utils_get_first_node_id(call_node, SYMBOL_ARG_LIST,
-                                                    &found);
+  TSNode args_node = node_table_first(nodes, call_node, SYMBOL_ARG_LIST,
+                                      &found);
   if (!found) {
     return FALSE;
   }
-  TSNode from_node = parse_utils_get_first_node_id(args_node,
-                                                    SYMBOL_IDENTIFIER, &found);
+  TSNode from_node = node_table_first(nodes, args_node, SYMBOL_IDENTIFIER,
+                                      &found);
   if (!found) {
     return FALSE;
   }
 
-  func_name = parse_utils_node_get_string(content, &func_name_node);
-  type_name = parse_utils_node_get_string(content, &type);
-
-  type_name_upper = g_ascii_strup(type_name, -1);
-  func_name_upper = g_string_new(func_name);
-  g_string_ascii_up(func_name_upper);
-  g_string_replace(func_name_upper, "_", "", -1);
-
-  if (g_strcmp0(type_name_upper, func_name_upper->str) != 0) {
-    g_free(func_name);
-    g_free(type_name);
-    g_free(type_name_upper);
-    g_string_free(func_name_upper, TRUE);
-
+  if (!cast_matches_type(content, func_name_node, type)) {
     return FALSE;
   }
 
-  *from = parse_utils_node_get_string(content, &from_node);
-  *to = parse_utils_node_get_string(content, &to_node);
-
-  g_free(func_name);
-  g_free(type_name);
-  g_free(type_name_upper);
-  g_string_free(func_name_upper, TRUE);
+  *from = from_node;
+  *to = to_node;
 
   return TRUE;
 }
 
 gboolean
-parse_utils_is_function_static(const gchar *content, TSNode p)
+parse_utils_is_function_static(const gchar *content,
+                               const node_table_t *nodes,
+                               TSNode p)
 {
+  gint index;
+
   g_assert(content);
-  for (guint i = 0; i < ts_node_named_child_count(p); i++) {
-    TSNode n = ts_node_named_child(p, i);
+  g_assert(nodes);
+
+  index = node_table_index(nodes, p);
+  if (index < 0) {
+    /* Not a node of this tree */
+    return FALSE;
+  }
+
+  for (gint child = node_table_first_child(nodes, index); child >= 0;
+       child = node_table_next_sibling(nodes, child)) {
+    TSNode n = node_table_node(nodes, child);
     if (ts_node_symbol(n) != SYMBOL_STORAGE_SPEC) {
       continue;
     }
@@ -151,51 +290,63 @@ parse_utils_is_function_static(const gchar *content, TSNode p)
   return FALSE;
 }
 
+/* The identifier at the bottom of the first named children below n */
+static gboolean
+first_identifier(TSNode n, TSNode *name)
+{
+  g_assert(name);
+
+  while (ts_node_symbol(n) != SYMBOL_IDENTIFIER) {
+    if (ts_node_is_null(n) || ts_node_named_child_count(n) == 0) {
+      return FALSE;
+    }
+    n = ts_node_named_child(n, 0);
+  }
+  *name = n;
+  return TRUE;
+}
+
 gboolean
-parse_utils_parameter_is_pointer(const gchar *content, TSNode param, gchar **name)
+parse_utils_parameter_is_pointer(const gchar *content,
+                                 const node_table_t *nodes,
+                                 TSNode param,
+                                 TSNode *name)
 {
+  gint index;
+
   g_assert(content);
+  g_assert(nodes);
   g_assert(name);
 
   if (ts_node_symbol(param) != SYMBOL_PARAM_DECLARATION) {
     return FALSE;
   }
+  index = node_table_index(nodes, param);
+  if (index < 0) {
+    /* Not a node of this tree */
+    return FALSE;
+  }
 
-  for (guint i = 0; i < ts_node_named_child_count(param); i++) {
-    TSNode n = ts_node_named_child(param, i);
-    TSNode c;
+  for (gint child = node_table_first_child(nodes, index); child >= 0;
+       child = node_table_next_sibling(nodes, child)) {
+    TSNode n = node_table_node(nodes, child);
 
     if (ts_node_symbol(n) == SYMBOL_TYPE) {
       /* check if it is a secret pointer (gpointer) */
       if (parse_utils_node_eq(content, &n, "gpointer") ||
           parse_utils_node_eq(content, &n, "gconstpointer")) {
-        c = ts_node_next_named_sibling(n);
-        while (ts_node_symbol(c) != SYMBOL_IDENTIFIER) {
-          if (ts_node_named_child_count(c) == 0) {
-            return FALSE;
-          }
-          c = ts_node_named_child(c, 0);
+        child = node_table_next_sibling(nodes, child);
+        if (child < 0) {
+          return FALSE;
         }
-        *name = parse_utils_node_get_string(content, &c);
-
-        return TRUE;
+        return first_identifier(node_table_node(nodes, child), name);
       }
     }
 
     if (ts_node_symbol(n) == SYMBOL_POINTER_DECLARATION) {
-      c = ts_node_named_child(n, 0);
-      while (ts_node_symbol(c) != SYMBOL_IDENTIFIER) {
-        if (ts_node_named_child_count(c) == 0 || ts_node_is_null(c)) {
-          return FALSE;
-        }
-        c = ts_node_named_child(c, 0);
-      }
-      *name = parse_utils_node_get_string(content, &c);
-
-      return TRUE;
+      return first_identifier(ts_node_named_child(n, 0), name);
     }
   }
-
   return FALSE;
 }
 gboolean
@@ -204,7 +355,7 @@ parse_utils_parameter_is_unused(const gchar *content, TSNode param)
   TSNode type;
   g_assert(content);
 
-  type = ts_node_child_by_field_name(param, "type", strlen("type"));
+  type = ts_node_child_by_field_id(param, FIELD_TYPE);
   if (ts_node_is_null(type)) {
     return false;
   }
@@ -2,23 +2,70 @@
 #include <glib.h>
 #include <tree_sitter/api.h>
 
-#define SYMBOL_IDENTIFIER          1
-#define SYMBOL_COMMENT             160
-#define SYMBOL_FUNCTION            196
-#define SYMBOL_DECLARATION         198
-#define SYMBOL_POINTER_DECLARATION 226
-#define SYMBOL_FUNC_DECLARATION    230
-#define SYMBOL_BODY                241
-#define SYMBOL_STORAGE_SPEC        242
-#define SYMBOL_STRUCT_SPEC         249
-#define SYMBOL_FIELD_DECL_LIST     251
-#define SYMBOL_FIELD_DECL          253
-#define SYMBOL_PARAM_DECLARATION   260
-#define SYMBOL_CAST_EXPRESSION     292
-#define SYMBOL_CALL_EXPRESSION     299
-#define SYMBOL_ARG_LIST            309
-#define SYMBOL_FIELD_IDENT         360
-#define SYMBOL_TYPE                362
+#include "node_table.h"
+
+/* Symbol and field ids of tree-sitter-c, looked up by name once by
+ * parse_utils_init() so a grammar upgrade cannot renumber them under us */
+struct parse_utils_symbols {
+  TSSymbol identifier;
+  TSSymbol comment;
+  TSSymbol function;
+  TSSymbol declaration;
+  TSSymbol pointer_declaration;
+  TSSymbol func_declaration;
+  TSSymbol storage_spec;
+  TSSymbol field_decl;
+  TSSymbol param_declaration;
+  TSSymbol cast_expression;
+  TSSymbol call_expression;
+  TSSymbol arg_list;
+  TSSymbol field_ident;
+  TSSymbol type;
+};
+
+struct parse_utils_fields {
+  TSFieldId arguments;
+  TSFieldId declarator;
+  TSFieldId function;
+  TSFieldId parameters;
+  TSFieldId type;
+};
+
+extern struct parse_utils_symbols parse_utils_symbols;
+extern struct parse_utils_fields parse_utils_fields;
+
+#define SYMBOL_IDENTIFIER          (parse_utils_symbols.identifier)
+#define SYMBOL_COMMENT             (parse_utils_symbols.comment)
+#define SYMBOL_FUNCTION            (parse_utils_symbols.function)
+#define SYMBOL_DECLARATION         (parse_utils_symbols.declaration)
+#define SYMBOL_POINTER_DECLARATION (parse_utils_symbols.pointer_declaration)
+#define SYMBOL_FUNC_DECLARATION    (parse_utils_symbols.func_declaration)
+#define SYMBOL_STORAGE_SPEC        (parse_utils_symbols.storage_spec)
+#define SYMBOL_FIELD_DECL          (parse_utils_symbols.field_decl)
+#define SYMBOL_PARAM_DECLARATION   (parse_utils_symbols.param_declaration)
+#define SYMBOL_CAST_EXPRESSION     (parse_utils_symbols.cast_expression)
+#define SYMBOL_CALL_EXPRESSION     (parse_utils_symbols.call_expression)
+#define SYMBOL_ARG_LIST            (parse_utils_symbols.arg_list)
+#define SYMBOL_FIELD_IDENT         (parse_utils_symbols.field_ident)
+#define SYMBOL_TYPE                (parse_utils_symbols.type)
+
+#define FIELD_ARGUMENTS  (parse_utils_fields.arguments)
+#define FIELD_DECLARATOR (parse_utils_fields.declarator)
+#define FIELD_FUNCTION   (parse_utils_fields.function)
+#define FIELD_PARAMETERS (parse_utils_fields.parameters)
+#define FIELD_TYPE       (parse_utils_fields.type)
+
+/* Resolves the ids above, safe to call from any thread and more than once */
+void parse_utils_init(void);
+
+/* Step through named children with a TSTreeCursor, which takes constant time
+ * per step where ts_node_named_child() scans all the siblings before the
+ * wanted one. first_named_child leaves the cursor on the parent when there
+ * are none, next_named_sibling stays on the last child, go back to the
+ * parent when done. */
+gboolean parse_utils_cursor_first_named_child(TSTreeCursor *cursor);
+
+gboolean parse_utils_cursor_next_named_sibling(TSTreeCursor *cursor);
 
 gboolean parse_utils_node_eq(const gchar *content,
                              TSNode *node,
@@ -26,17 +73,24 @@ gboolean parse_utils_node_eq(const gchar *content,
 
 gchar *parse_utils_node_get_string(const gchar *content, TSNode *node);
 
-gboolean parse_utils_is_function_static(const gchar *content, TSNode p);
+gboolean parse_utils_is_function_static(const gchar *content,
+                                        const node_table_t *nodes,
+                                        TSNode p);
 
+/* name is set to the identifier of the pointer */
 gboolean parse_utils_parameter_is_pointer(const gchar *content,
+                                          const node_table_t *nodes,
                                           TSNode param,
-                                          gchar **name);
+                                          TSNode *name);
 
 gboolean parse_utils_parameter_is_unused(const gchar *content, TSNode param);
 
+/* Whether decl is like MyType *to = MY_TYPE(from), to and from are set to
+ * the identifiers when it is */
 gboolean parse_utils_is_gobject_cast(const gchar *content,
-                                      TSNode decl,
-                                      gchar **to,
-                                      gchar **from);
+                                     const node_table_t *nodes,
+                                     TSNode decl,
+                                     TSNode *to,
+                                     TSNode *from);
 
 TSNode parse_utils_get_first_node_id(TSNode check, guint id, gboolean *found);
@@ -1,6 +1,10 @@
 #include <glib.h>
+#include <stdlib.h>
+#include <string.h>
 #include <tree_sitter/api.h>
 
+#include "function_table.h"
+#include "parse_utils.h"
 #include "parser.h"
 
 const TSLanguage *tree_sitter_c(void);
@@ -13,17 +17,27 @@ clear(gpointer data)
     return;
   }
 
+  if (ctx->whole != NULL) {
+    /* Units only own their references */
+    g_clear_object(&ctx->cancellable);
+    parser_unref(ctx->whole);
+    return;
+  }
+
   message_free(ctx->message);
   g_free(ctx->content);
   g_free(ctx->file);
   g_free(ctx->language);
+  g_clear_object(&ctx->cancellable);
   /* Free tree-sitter stuff */
+  function_table_free((function_table_t *) ctx->functions);
+  node_table_free(ctx->nodes);
   ts_tree_delete(ctx->tree);
   ts_parser_delete(ctx->parser);
 }
 
 parser_t *
-parser_new(message_t *msg, GHashTable *files)
+parser_new_deferred(message_t *msg, GHashTable *files)
 {
   parser_t *parser;
   parser = g_atomic_rc_box_new0(struct parser_ctx);
@@ -32,10 +46,16 @@ parser_new(message_t *msg, GHashTable *files)
   case MESSAGE_TYPE_OPEN:
     parser->content = g_strdup(msg->data.open.text);
     parser->file = g_strdup(msg->data.open.uri);
+    parser->version = msg->data.open.version;
     break;
   case MESSAGE_TYPE_CHANGE:
     parser->content = g_strdup(msg->data.change.text);
     parser->file = g_strdup(msg->data.change.uri);
+    parser->version = msg->data.change.version;
+    break;
+  case MESSAGE_TYPE_SAVE:
+    parser->content = g_strdup(msg->data.save.text);
+    parser->file = g_strdup(msg->data.save.uri);
     break;
   case MESSAGE_TYPE_DIAGNOSTIC:
     parser->content = g_strdup(msg->data.diagnostic.document.text);
@@ -52,24 +72,218 @@ parser_new(message_t *msg, GHashTable *files)
   } else if (parser->file != NULL) {
     parser->content = g_strdup(g_hash_table_lookup(files, parser->file));
   }
-
   if (parser->content != NULL) {
+    parser->content_len = strlen(parser->content);
+  }
+
+  return parser;
+}
+
+/* Moves point over text[from, to) */
+static TSPoint
+advance(const gchar *text, gsize from, gsize to, TSPoint point)
+{
+  const gchar *nl;
+
+  while ((nl = memchr(text + from, '\n', to - from)) != NULL) {
+    point.row++;
+    point.column = 0;
+    from = nl - text + 1;
+  }
+  point.column += to - from;
+
+  return point;
+}
+
+/* The single edit turning old into now, between their common prefix and
+ * suffix */
+static void
+find_edit(const gchar *old, const gchar *now, TSInputEdit *edit)
+{
+  gsize old_len = strlen(old);
+  gsize len = strlen(now);
+  gsize prefix = 0;
+  gsize suffix = 0;
+  TSPoint origin = {0, 0};
+
+  while (prefix < old_len && prefix < len && old[prefix] == now[prefix]) {
+    prefix++;
+  }
+  while (suffix < old_len - prefix && suffix < len - prefix &&
+         old[old_len - suffix - 1] == now[len - suffix - 1]) {
+    suffix++;
+  }
+
+  edit->start_byte = prefix;
+  edit->old_end_byte = old_len - suffix;
+  edit->new_end_byte = len - suffix;
+  edit->start_point = advance(now, 0, prefix, origin);
+  edit->old_end_point = advance(old, prefix, edit->old_end_byte,
+                                edit->start_point);
+  edit->new_end_point = advance(now, prefix, edit->new_end_byte,
+                                edit->start_point);
+}
+
+/* A copy of the tree of old, edited to line up with the content of
+ * parser */
+static TSTree *
+edited_tree(parser_t *old, parser_t *parser, TSInputEdit *edit)
+{
+  TSTree *tree;
+
+  find_edit(old->content, parser->content, edit);
+  tree = ts_tree_copy(old->tree);
+  ts_tree_edit(tree, edit);
+
+  return tree;
+}
+
+void
+parser_parse(parser_t *parser)
+{
+  parser_parse_from(parser, NULL);
+}
+
+void
+parser_parse_from(parser_t *parser, parser_t *old)
+{
+  TSTree *old_tree = NULL;
+  TSInputEdit edit;
+
+  g_assert(parser);
+
+  if (parser->content != NULL && parser->tree == NULL) {
+    parse_utils_init();
     parser->parser = ts_parser_new();
 
     // Set the parser's language (JSON in this case).
     ts_parser_set_language(parser->parser, tree_sitter_c());
 
-    // Build a syntax tree based on source code stored in a string.
-    parser->tree = ts_parser_parse_string(parser->parser, NULL, parser->content,
-                                          strlen(parser->content));
+    if (old != NULL && old->tree != NULL) {
+      old_tree = edited_tree(old, parser, &edit);
+    }
+
+    // Build a syntax tree based on source code stored in a string, reusing
+    // the unchanged subtrees of the old one.
+    parser->tree = ts_parser_parse_string(parser->parser, old_tree,
+                                          parser->content,
+                                          parser->content_len);
+    if (old_tree != NULL) {
+      ts_tree_delete(old_tree);
+    }
 
     // Get the root node of the syntax tree.
     parser->root_node = ts_tree_root_node(parser->tree);
+    parser->nodes = node_table_new(parser->root_node, parser->content);
   }
+}
+
+parser_t *
+parser_new(message_t *msg, GHashTable *files)
+{
+  parser_t *parser;
+
+  parser = parser_new_deferred(msg, files);
+  parser_parse(parser);
 
   return parser;
 }
 
+GArray *
+parser_changed_ranges(parser_t *old, parser_t *parser, TSInputEdit *edit)
+{
+  GArray *ranges;
+  TSRange *changed;
+  TSRange edited;
+  TSTree *tree;
+  guint32 count;
+
+  g_assert(old);
+  g_assert(parser);
+  g_assert(edit);
+  g_assert(old->tree != NULL);
+  g_assert(parser->tree != NULL);
+
+  tree = edited_tree(old, parser, edit);
+  changed = ts_tree_get_changed_ranges(tree, parser->tree, &count);
+  ts_tree_delete(tree);
+
+  ranges = g_array_sized_new(FALSE, FALSE, sizeof(TSRange), count + 1);
+  g_array_append_vals(ranges, changed, count);
+  free(changed);
+
+  /* Text changed within a token keeps the syntax, but not the problems */
+  edited.start_byte = edit->start_byte;
+  edited.end_byte = edit->new_end_byte;
+  edited.start_point = edit->start_point;
+  edited.end_point = edit->new_end_point;
+  g_array_append_val(ranges, edited);
+
+  return ranges;
+}
+
+gsize
+parser_edit_size(parser_t *old, parser_t *parser)
+{
+  TSInputEdit edit;
+
+  g_assert(old);
+  g_assert(parser);
+  g_assert(old->content != NULL);
+  g_assert(parser->content != NULL);
+
+  find_edit(old->content, parser->content, &edit);
+  return MAX(edit.old_end_byte, edit.new_end_byte) - edit.start_byte;
+}
+
+parser_t *
+parser_unit_new(parser_t *whole, guint start, guint end)
+{
+  parser_t *unit;
+
+  g_assert(whole);
+  g_assert(whole->whole == NULL);
+  g_assert(whole->tree != NULL);
+
+  unit = g_atomic_rc_box_new0(struct parser_ctx);
+  unit->whole = parser_ref(whole);
+  unit->message = whole->message;
+  unit->content = whole->content;
+  unit->content_len = whole->content_len;
+  unit->file = whole->file;
+  unit->language = whole->language;
+  unit->version = whole->version;
+  if (whole->cancellable != NULL) {
+    unit->cancellable = g_object_ref(whole->cancellable);
+  }
+  /* Units of one file run on several threads at once over the same tree,
+   * its node table and its function table. Nothing edits the tree of a
+   * parser once it is built, edits go to copies, and reading nodes of a tree
+   * nobody edits is safe from any thread. Every thread has its own cursors. */
+  unit->tree = whole->tree;
+  unit->root_node = whole->root_node;
+  unit->nodes = whole->nodes;
+  unit->summaries = whole->summaries;
+  unit->unit_start = start;
+  unit->unit_end = end;
+
+  return unit;
+}
+
+guint
+parser_unit_end(parser_t *ctx)
+{
+  g_assert(ctx);
+
+  if (ctx->whole != NULL) {
+    return ctx->unit_end;
+  }
+  if (ctx->tree == NULL) {
+    return 0;
+  }
+  return ts_node_named_child_count(ctx->root_node);
+}
+
 parser_t*
 parser_ref(parser_t *ctx) {
     return g_atomic_rc_box_acquire(ctx);
@@ -83,3 +297,26 @@ parser_unref(parser_t *ctx)
   }
   g_atomic_rc_box_release_full(ctx, clear);
 }
+
+gboolean
+parser_is_cancelled(parser_t *ctx)
+{
+  g_assert(ctx);
+
+  return ctx->cancellable != NULL &&
+         g_cancellable_is_cancelled(ctx->cancellable);
+}
+
+function_table_t *
+parser_get_functions(parser_t *ctx)
+{
+  g_assert(ctx);
+
+  if (ctx->whole != NULL) {
+    return parser_get_functions(ctx->whole);
+  }
+  if (g_once_init_enter(&ctx->functions)) {
+    g_once_init_leave(&ctx->functions, (gsize) function_table_new(ctx));
+  }
+  return (function_table_t *) ctx->functions;
+}
@@ -1,25 +1,76 @@
 #pragma once
+#include <gio/gio.h>
 #include <glib.h>
 #include <tree_sitter/api.h>
 
 #include "message.h"
+#include "node_table.h"
 
 G_BEGIN_DECLS
 
+struct function_table;
+struct summary_store;
+
 struct parser_ctx {
   message_t *message;
   gchar *content;
+  /* strlen() of content, 0 without */
+  gsize content_len;
   gchar *file;
   gchar *language;
+  gint64 version;
+  /* Cancelled when a newer version of the file arrives, may be NULL */
+  GCancellable *cancellable;
   TSParser *parser;
   TSTree *tree;
   TSNode root_node;
+  /* Named nodes of tree in preorder, built with it */
+  node_table_t *nodes;
+  /* Set for units, which borrow everything above from the whole file */
+  struct parser_ctx *whole;
+  /* Range of top level nodes (named children of root_node) to analyze */
+  guint unit_start;
+  guint unit_end;
+  /* struct function_table, built on first use by parser_get_functions() */
+  gsize functions;
+  /* What the functions of other files assert, borrowed, may be NULL */
+  struct summary_store *summaries;
 };
 typedef struct parser_ctx parser_t;
 
 parser_t *parser_new(message_t *msg, GHashTable *files);
 
+/* Like parser_new() but the tree is built later by parser_parse() */
+parser_t *parser_new_deferred(message_t *msg, GHashTable *files);
+
+void parser_parse(parser_t *parser);
+
+/* Like parser_parse() but reuses the tree of old, which may be NULL, for the
+ * parts of the content that did not change */
+void parser_parse_from(parser_t *parser, parser_t *old);
+
+/* TSRange in parser of everything whose syntax differs from old, the edited
+ * text included. edit gets the single edit between their contents. Both
+ * must be parsed. */
+GArray *parser_changed_ranges(parser_t *old,
+                              parser_t *parser,
+                              TSInputEdit *edit);
+
+/* Bytes the single edit turning the content of old into that of parser
+ * replaced or inserted, whichever is more */
+gsize parser_edit_size(parser_t *old, parser_t *parser);
+
+/* A view of the top level nodes [start, end) of a parsed file */
+parser_t *parser_unit_new(parser_t *whole, guint start, guint end);
+
+guint parser_unit_end(parser_t *parser);
+
 void parser_unref(parser_t *parser);
 
 parser_t *parser_ref(parser_t *parser);
+
+gboolean parser_is_cancelled(parser_t *parser);
+
+/* The functions of the whole file, units share them */
+struct function_table *parser_get_functions(parser_t *parser);
 G_END_DECLS
@@ -0,0 +1,315 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <tree_sitter/api.h>
+
+#include "problems.h"
+
+problems_t *
+problems_new(void)
+{
+  problems_t *problems;
+
+  problems = g_new0(problems_t, 1);
+  problems->items = g_array_new(FALSE, FALSE, sizeof(struct problem));
+  problems->text = g_string_new(NULL);
+
+  return problems;
+}
+
+void
+problems_free(problems_t *problems)
+{
+  if (problems == NULL) {
+    return;
+  }
+  g_array_unref(problems->items);
+  g_string_free(problems->text, TRUE);
+  g_free(problems);
+}
+
+void
+problems_clear(problems_t *problems)
+{
+  g_assert(problems);
+
+  g_array_set_size(problems->items, 0);
+  g_string_truncate(problems->text, 0);
+}
+
+problems_t *
+problems_copy(const problems_t *problems)
+{
+  problems_t *copy = problems_new();
+
+  if (problems != NULL) {
+    problems_append(copy, problems);
+    copy->rule = problems->rule;
+  }
+  return copy;
+}
+
+guint
+problems_len(const problems_t *problems)
+{
+  return problems != NULL ? problems->items->len : 0;
+}
+
+struct problem *
+problems_get(const problems_t *problems, guint i)
+{
+  g_assert(problems);
+  g_assert(i < problems->items->len);
+
+  return &g_array_index(problems->items, struct problem, i);
+}
+
+/* Bytes taken by the arguments of p */
+static gsize
+args_size(const problems_t *problems, const struct problem *p)
+{
+  const gchar *args = problems->text->str + p->args;
+  const gchar *a = args;
+
+  for (guint i = rules_get(p->id)->n_args; i > 0; i--) {
+    a += strlen(a) + 1;
+  }
+  return a - args;
+}
+
+void
+problems_format(const problems_t *problems,
+                const struct problem *p,
+                GString *out)
+{
+  const gchar *message;
+  const gchar *arg;
+  const gchar *s;
+
+  g_assert(problems);
+  g_assert(p);
+  g_assert(out);
+
+  message = rules_get(p->id)->message;
+  arg = problems->text->str + p->args;
+  while ((s = strstr(message, "%s")) != NULL) {
+    g_string_append_len(out, message, s - message);
+    g_string_append(out, arg);
+    arg += strlen(arg) + 1;
+    message = s + 2;
+  }
+  g_string_append(out, message);
+}
+
+static void
+add_valist(problems_t *problems,
+           enum rule_id id,
+           guint32 start_line,
+           guint32 start_char,
+           guint32 end_line,
+           guint32 end_char,
+           va_list args)
+{
+  struct problem p;
+
+  p.start_line = start_line;
+  p.start_char = start_char;
+  p.end_line = end_line;
+  p.end_char = end_char;
+  p.args = problems->text->len;
+  p.rule = problems->rule;
+  p.id = id;
+
+  for (guint i = rules_get(id)->n_args; i > 0; i--) {
+    const gchar *arg = va_arg(args, const gchar *);
+
+    g_assert(arg);
+    /* Keep the nul, the next argument starts after it */
+    g_string_append_len(problems->text, arg, strlen(arg) + 1);
+  }
+  g_array_append_val(problems->items, p);
+}
+
+void
+problems_add(problems_t *problems,
+             enum rule_id id,
+             guint32 start_line,
+             guint32 start_char,
+             guint32 end_line,
+             guint32 end_char,
+             ...)
+{
+  va_list args;
+
+  g_assert(problems);
+
+  va_start(args, end_char);
+  add_valist(problems, id, start_line, start_char, end_line, end_char, args);
+  va_end(args);
+}
+
+void
+problems_add_node(problems_t *problems,
+                  enum rule_id id,
+                  TSNode start,
+                  TSNode end,
+                  ...)
+{
+  TSPoint from = ts_node_start_point(start);
+  TSPoint to = ts_node_end_point(end);
+  va_list args;
+
+  g_assert(problems);
+
+  va_start(args, end);
+  add_valist(problems, id, from.row, from.column, to.row, to.column, args);
+  va_end(args);
+}
+
+void
+problems_add_node_texts(problems_t *problems,
+                        enum rule_id id,
+                        TSNode start,
+                        TSNode end,
+                        const gchar *content,
+                        const TSNode *args)
+{
+  TSPoint from = ts_node_start_point(start);
+  TSPoint to = ts_node_end_point(end);
+  struct problem p;
+  guint n_args;
+
+  g_assert(problems);
+  g_assert(content);
+
+  n_args = rules_get(id)->n_args;
+  g_assert(args != NULL || n_args == 0);
+
+  p.start_line = from.row;
+  p.start_char = from.column;
+  p.end_line = to.row;
+  p.end_char = to.column;
+  p.args = problems->text->len;
+  p.rule = problems->rule;
+  p.id = id;
+
+  for (guint i = 0; i < n_args; i++) {
+    if (!ts_node_is_null(args[i])) {
+      g_string_append_len(problems->text, content + ts_node_start_byte(args[i]),
+                          ts_node_end_byte(args[i]) -
+                            ts_node_start_byte(args[i]));
+    }
+    g_string_append_c(problems->text, '\0');
+  }
+  g_array_append_val(problems->items, p);
+}
+
+void
+problems_add_copy(problems_t *problems, const problems_t *src, guint i)
+{
+  struct problem p;
+  gsize size;
+
+  g_assert(problems);
+  g_assert(src);
+
+  p = *problems_get(src, i);
+  size = args_size(src, &p);
+  g_string_append_len(problems->text, src->text->str + p.args, size);
+  p.args = problems->text->len - size;
+  g_array_append_val(problems->items, p);
+}
+
+void
+problems_append(problems_t *problems, const problems_t *src)
+{
+  guint first;
+  guint32 base;
+
+  g_assert(problems);
+
+  if (problems_len(src) == 0) {
+    return;
+  }
+
+  /* Both buffers are copied whole, only the offsets move */
+  first = problems->items->len;
+  base = problems->text->len;
+  g_array_append_vals(problems->items, src->items->data, src->items->len);
+  g_string_append_len(problems->text, src->text->str, src->text->len);
+  for (guint i = first; i < problems->items->len; i++) {
+    problems_get(problems, i)->args += base;
+  }
+}
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME  1099511628211ull
+
+static guint64
+hash_bytes(guint64 hash, gconstpointer data, gsize len)
+{
+  const guchar *b = data;
+
+  for (gsize i = 0; i < len; i++) {
+    hash = (hash ^ b[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+guint64
+problems_hash(const problems_t *problems)
+{
+  guint64 hash = FNV_OFFSET;
+
+  for (guint i = 0; i < problems_len(problems); i++) {
+    const struct problem *p = problems_get(problems, i);
+    guint32 fields[5];
+
+    /* Not the rule index, it is invisible to the client */
+    fields[0] = p->start_line;
+    fields[1] = p->start_char;
+    fields[2] = p->end_line;
+    fields[3] = p->end_char;
+    fields[4] = p->id;
+    hash = hash_bytes(hash, fields, sizeof(fields));
+    hash = hash_bytes(hash, problems->text->str + p->args,
+                      args_size(problems, p));
+  }
+  return hash;
+}
+
+static gint
+compare_pos(guint32 line_a, guint32 char_a, guint32 line_b, guint32 char_b)
+{
+  if (line_a != line_b) {
+    return line_a < line_b ? -1 : 1;
+  }
+  if (char_a != char_b) {
+    return char_a < char_b ? -1 : 1;
+  }
+  return 0;
+}
+
+static gint
+compare_problems(gconstpointer a, gconstpointer b)
+{
+  const struct problem *pa = (const struct problem *) a;
+  const struct problem *pb = (const struct problem *) b;
+  gint res;
+
+  res = compare_pos(pa->start_line, pa->start_char, pb->start_line,
+                    pb->start_char);
+  if (res != 0) {
+    return res;
+  }
+  return compare_pos(pa->end_line, pa->end_char, pb->end_line, pb->end_char);
+}
+
+void
+problems_sort(problems_t *problems)
+{
+  g_assert(problems);
+
+  /* Stable, like sorting the lists was */
+  g_array_sort(problems->items, compare_problems);
+}
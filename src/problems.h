@@ -0,0 +1,95 @@
+#pragma once
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+#include "rules.h"
+
+G_BEGIN_DECLS
+
+/* The problems of an analysis in one flat array, the arguments of their
+ * messages one after the other in a single buffer. Adding a problem
+ * allocates nothing once both have grown, and freeing is constant time.
+ * Messages are only formatted when they are sent. */
+typedef struct problems problems_t;
+
+struct problem {
+  guint32 start_line;
+  guint32 start_char;
+  guint32 end_line;
+  guint32 end_char;
+  /* Offset in the text of the array of the arguments of the message, nul
+   * terminated one after the other */
+  guint32 args;
+  /* Index of the rule that found it */
+  guint16 rule;
+  /* enum rule_id, the kind of problem */
+  guint16 id;
+};
+
+struct problems {
+  /* struct problem */
+  GArray *items;
+  GString *text;
+  /* Rule of the problems added next */
+  guint16 rule;
+};
+
+problems_t *problems_new(void);
+
+void problems_free(problems_t *problems);
+
+/* Drops all problems, keeping the memory */
+void problems_clear(problems_t *problems);
+
+problems_t *problems_copy(const problems_t *problems);
+
+guint problems_len(const problems_t *problems);
+
+struct problem *problems_get(const problems_t *problems, guint i);
+
+/* Appends the message of p to out */
+void problems_format(const problems_t *problems,
+                     const struct problem *p,
+                     GString *out);
+
+/* Adds a problem of kind id, followed by the strings its message takes */
+void problems_add(problems_t *problems,
+                  enum rule_id id,
+                  guint32 start_line,
+                  guint32 start_char,
+                  guint32 end_line,
+                  guint32 end_char,
+                  ...);
+
+/* Adds a problem from the start of start to the end of end */
+void problems_add_node(problems_t *problems,
+                       enum rule_id id,
+                       TSNode start,
+                       TSNode end,
+                       ...);
+
+/* Adds a problem from the start of start to the end of end, the arguments
+ * of its message are the text in content of the nodes of args. Null nodes
+ * give empty strings. */
+void problems_add_node_texts(problems_t *problems,
+                             enum rule_id id,
+                             TSNode start,
+                             TSNode end,
+                             const gchar *content,
+                             const TSNode *args);
+
+/* Adds a copy of the problem at i of src */
+void problems_add_copy(problems_t *problems, const problems_t *src, guint i);
+
+/* Adds copies of all problems of src */
+void problems_append(problems_t *problems, const problems_t *src);
+
+/* Hash of what the client is shown of the problems: positions, kinds and
+ * messages, in order */
+guint64 problems_hash(const problems_t *problems);
+
+/* Orders the problems by position in the file, keeping the order of those
+ * at the same place */
+void problems_sort(problems_t *problems);
+
+G_END_DECLS
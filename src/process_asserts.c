@@ -1,285 +1,152 @@
 #include <glib.h>
 #include <tree_sitter/api.h>
 
+#include "function_table.h"
 #include "message.h"
 #include "parse_utils.h"
 #include "parser.h"
 #include "process_asserts.h"
 #include "processor.h"
+#include "visitor.h"
 
-static void
-collect_asserts(GHashTable *res, const gchar *content, TSNode check)
-{
-  g_assert(res);
-  g_assert(content);
-
-  for (guint i = 0; i < ts_node_named_child_count(check); i++) {
-    TSNode args;
-    TSNode arg;
-    TSNode function;
-    gboolean found = FALSE;
-    TSNode n = ts_node_named_child(check, i);
-
-    if (ts_node_symbol(n) != SYMBOL_CALL_EXPRESSION) {
-      collect_asserts(res, content, n);
-      continue;
-    }
-
-    function = ts_node_child_by_field_name(n, "function", strlen("function"));
-    args = ts_node_child_by_field_name(n, "arguments", strlen("arguments"));
-
-    if (ts_node_is_null(function) || ts_node_is_null(args)) {
-      return;
-    }
-
-    if (ts_node_named_child_count(args) != 1) {
-      /* g_assert should have exactly 1 arg */
-      return;
-    }
-    if (!parse_utils_node_eq(content, &function, "g_assert")) {
-      return;
-    }
-    arg = parse_utils_get_first_node_id(args, SYMBOL_IDENTIFIER, &found);
-
-    if (found) {
-      g_hash_table_insert(res, parse_utils_node_get_string(content, &arg), &arg);
-    }
-  }
-}
-
-static void
-collect_renames(GHashTable *res, const gchar *content, TSNode check)
-{
-  gchar *to_str;
-  gchar *from_str;
-
-  g_assert(res);
-  g_assert(content);
-
-  for (guint i = 0; i < ts_node_named_child_count(check); i++) {
-    TSNode n = ts_node_named_child(check, i);
-    TSNode decl;
-    TSNode to;
-    TSNode from;
+/* Static functions, the only ones whose parameters should be asserted, are
+ * told apart in check_asserts() */
+#define FUNCTION_QUERY                                                         \
+  "(function_definition declarator: (function_declarator)) @function"
 
-    if (ts_node_symbol(n) != SYMBOL_DECLARATION) {
-      collect_renames(res, content, n);
-      continue;
-    }
-
-    decl = ts_node_child_by_field_name(n, "declarator", strlen("declarator"));
-    to = parse_utils_get_first_node_id(decl, SYMBOL_IDENTIFIER, NULL);
-
-    from = parse_utils_get_first_node_id(decl, SYMBOL_CAST_EXPRESSION, NULL);
-
-    if (parse_utils_is_gobject_cast(content, n, &to_str, &from_str)) {
-      g_hash_table_insert(res, from_str, to_str);
-      return;
-    }
-
-    if (ts_node_symbol(from) != SYMBOL_CAST_EXPRESSION) {
-      continue;
-    }
-
-    from = parse_utils_get_first_node_id(from, SYMBOL_IDENTIFIER, NULL);
-
-    if (ts_node_symbol(from) != SYMBOL_IDENTIFIER ||
-        ts_node_symbol(to) != SYMBOL_IDENTIFIER) {
-      continue;
-    }
-    g_hash_table_insert(res, parse_utils_node_get_string(content, &from),
-                        parse_utils_node_get_string(content, &to));
-    return;
-  }
-}
+static const gchar *const function_captures[] = {"function", NULL};
 
+/* Whether the lowercased text contains needle in any case. memchr() finds
+ * the candidates, which the C library does a word or vector at a time. */
 static gboolean
-mentioned_with_null(const gchar *content, const gchar *var, TSNode function)
+contains_lower(const gchar *text, gsize len, const gchar *needle)
 {
-  gboolean res = FALSE;
-  gchar *var_lower = NULL;
-  gchar *comment = NULL;
-  gchar *comment_lower = NULL;
+  const gchar *end = text + len;
+  gsize needle_len;
+  gchar first;
 
-  g_assert(content);
-  g_assert(var);
+  g_assert(text);
+  g_assert(needle);
 
-  var_lower = g_utf8_strdown(var, -1);
+  needle_len = strlen(needle);
+  if (needle_len == 0) {
+    return TRUE;
+  }
+  first = g_ascii_tolower(needle[0]);
 
-  for (guint i = 0; i < ts_node_named_child_count(function); i++) {
-    TSNode n = ts_node_named_child(function, i);
-    if (ts_node_symbol(n) == SYMBOL_COMMENT) {
-      comment = parse_utils_node_get_string(content, &n);
-      comment_lower = g_utf8_strdown(comment, -1);
+  while ((gsize) (end - text) >= needle_len) {
+    gsize i;
 
-      if (g_strstr_len(comment_lower, -1, var_lower) != NULL &&
-          g_strstr_len(comment_lower, -1, "null") != NULL) {
-        res = TRUE;
-        goto out;
+    text = memchr(text, first, end - text - needle_len + 1);
+    if (text == NULL) {
+      return FALSE;
+    }
+    for (i = 1; i < needle_len; i++) {
+      if (text[i] != g_ascii_tolower(needle[i])) {
+        break;
       }
-      g_clear_pointer(&comment, g_free);
-      g_clear_pointer(&comment_lower, g_free);
     }
-    res = mentioned_with_null(content, var, n);
-    if (res) {
-      goto out;
+    if (i == needle_len) {
+      return TRUE;
     }
+    text++;
   }
-
-  /* Fall through */
-out:
-  g_clear_pointer(&var_lower, g_free);
-  g_clear_pointer(&comment, g_free);
-  g_clear_pointer(&comment_lower, g_free);
-  return res;
+  return FALSE;
 }
 
+/* A comment of the function mentions both var and null */
 static gboolean
-renamed_assert(GHashTable *asserts, GHashTable *renames, const gchar *param)
+mentioned_with_null(const function_table_t *functions,
+                    const struct function_info *info,
+                    const gchar *var)
 {
-  const gchar *p;
-
-  g_assert(asserts);
-  g_assert(renames);
-  g_assert(param);
-
-  if (!g_hash_table_contains(renames, param)) {
-    return FALSE;
-  }
-
-  p = g_hash_table_lookup(renames, param);
+  const struct function_comment *comments;
+  const gchar *text;
 
-  if (g_hash_table_contains(asserts, p)) {
-    return TRUE;
-  }
+  g_assert(functions);
+  g_assert(info);
+  g_assert(var);
 
-  return renamed_assert(asserts, renames, p);
-}
+  comments = function_table_comments(functions, info);
+  text = functions->comment_text->str;
 
-static gboolean
-contains_gerror_check(const gchar *content, TSNode function)
-{
-  g_assert(content);
-
-  for (guint i = 0; i < ts_node_named_child_count(function); i++) {
-    TSNode n = ts_node_named_child(function, i);
-    if (parse_utils_node_eq(content, &n, "err == NULL || *err == NULL") ||
-        contains_gerror_check(content, n)) {
+  for (guint i = 0; i < info->n_comments; i++) {
+    if (comments[i].null &&
+        contains_lower(text + comments[i].start, comments[i].len, var)) {
       return TRUE;
     }
   }
-
   return FALSE;
 }
 
-static gboolean
-invalid_gerror_assert(const gchar *content,
-                      TSNode param,
-                      TSNode function,
-                      struct problem **p)
-{
-  g_assert(content);
-  g_assert(p);
-
-  if (!parse_utils_node_eq(content, &param, "GError **err")) {
-    return FALSE;
-  }
-
-  if (!contains_gerror_check(content, function)) {
-    *p = message_problem_new(3, &param, &param,
-                             "GErrors should be asserted (err == NULL || *err "
-                             "== NULL)");
-
-    return TRUE;
-  }
-
-  return TRUE;
-}
-
 static void
-check_asserts(const gchar *content, TSNode function, GList **problems)
+check_asserts(parser_t *parser, TSNode function, problems_t *problems)
 {
-  GHashTable *asserts;
-  GHashTable *renames;
-  TSNode decl;
-  TSNode params;
+  const function_table_t *functions;
+  const struct function_info *info;
+  const struct function_param *params;
 
-  g_assert(content);
+  g_assert(parser);
   g_assert(problems);
 
-  if (ts_node_symbol(function) != SYMBOL_FUNCTION) {
-    return;
-  }
-  if (!parse_utils_is_function_static(content, function)) {
+  functions = parser_get_functions(parser);
+  info = function_table_lookup(functions, function);
+  if (info == NULL || !info->is_static) {
     return;
   }
+  params = function_table_params(functions, info);
 
-  asserts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  renames = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
-  collect_asserts(asserts, content, function);
-  collect_renames(renames, content, function);
-
-  decl = ts_node_child_by_field_name(function, "declarator",
-                                     strlen("declarator"));
-  if (ts_node_is_null(decl)) {
-    goto ok;
-  }
-  params = ts_node_child_by_field_name(decl, "parameters", strlen("parameters"));
-  if (ts_node_is_null(params)) {
-    goto ok;
-  }
-
-  for (guint i = 0; i < ts_node_named_child_count(params); i++) {
-    gchar *param = NULL;
-    TSNode param_node;
+  for (guint i = 0; i < info->n_params; i++) {
+    const struct function_param *param = &params[i];
+    TSNode node;
 
-    param_node = ts_node_named_child(params, i);
-    if (!parse_utils_parameter_is_unused(content, param_node) &&
-        parse_utils_parameter_is_pointer(content, param_node, &param)) {
-      struct problem *p = NULL;
+    if (param->unused || !param->pointer || param->name == 0) {
+      continue;
+    }
+    node = param->node;
 
-      if (invalid_gerror_assert(content, param_node, function, &p)) {
-        if (p != NULL) {
-          *problems = g_list_prepend(*problems, p);
-        }
-      } else if (!g_hash_table_contains(asserts, param) &&
-                 !mentioned_with_null(content, param, function) &&
-                 !renamed_assert(asserts, renames, param)) {
-        p = message_problem_new(3, &param_node, &param_node,
-                                "Parameter %s should be asserted", param);
-        *problems = g_list_prepend(*problems, p);
+    if (param->gerror) {
+      if (!info->gerror_checked) {
+        problems_add_node(problems, RULE_ASSERT_GERROR, node, node);
       }
-      g_free(param);
+    } else if (!param->asserted &&
+               !mentioned_with_null(functions, info,
+                                    node_table_ident_name(parser->nodes,
+                                                          param->name))) {
+      problems_add_node(problems, RULE_ASSERT_PARAM, node, node,
+                        node_table_ident_name(parser->nodes, param->name));
     }
   }
-
-  /* Fall through */
-ok:
-  g_hash_table_unref(asserts);
 }
 
 static void
-recurse_check(const gchar *content, TSNode p, GList **problems)
+match_function(struct visit_ctx *v,
+               const TSNode *captures,
+               G_GNUC_UNUSED gpointer user_data)
 {
-  g_assert(content);
-  g_assert(problems);
+  g_assert(v);
+  g_assert(captures);
+
+  check_asserts(v->parser, captures[0], v->problems);
+}
 
-  for (guint i = 0; i < ts_node_named_child_count(p); i++) {
-    TSNode n = ts_node_named_child(p, i);
+/* Whether a parameter is asserted also depends on the functions it is
+ * passed to, wherever they are */
+static guint64
+callee_context(parser_t *parser, guint32 start_byte, guint32 end_byte)
+{
+  g_assert(parser);
 
-    check_asserts(content, n, problems);
-    recurse_check(content, n, problems);
-  }
+  return function_table_summary_hash(parser_get_functions(parser),
+                                     start_byte, end_byte);
 }
 
-GList *
-process_asserts(parser_t *parser, G_GNUC_UNUSED struct process_ctx *ctx)
+void
+process_asserts_register(visitor_t *visitor, guint rule)
 {
-  GList *res = NULL;
-  if (parser->message->type == MESSAGE_TYPE_DIAGNOSTIC ||
-      parser->message->type == MESSAGE_TYPE_OPEN ||
-      parser->message->type == MESSAGE_TYPE_CHANGE) {
-    recurse_check(parser->content, parser->root_node, &res);
-  }
-  return res;
+  g_assert(visitor);
+
+  visitor_add_query(visitor, rule, FUNCTION_QUERY, function_captures,
+                    match_function, NULL);
+  visitor_set_context(visitor, rule, callee_context);
 }
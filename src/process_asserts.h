@@ -2,7 +2,6 @@
 
 #include "parser.h"
 #include "processor.h"
+#include "visitor.h"
 
-GList *
-process_asserts(parser_t *parser, struct process_ctx *ctx);
-
+void process_asserts_register(visitor_t *visitor, guint rule);
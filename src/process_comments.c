@@ -1,330 +1,352 @@
 #include <glib.h>
 #include <tree_sitter/api.h>
 
+#include "doc_comment.h"
+#include "function_table.h"
 #include "message.h"
 #include "parse_utils.h"
 #include "parser.h"
 #include "process_comments.h"
 #include "processor.h"
+#include "visitor.h"
+
+/* Top level function prototypes, also when returning pointers */
+#define PROTOTYPE_QUERY                                                        \
+  "(translation_unit"                                                          \
+  "  (declaration"                                                             \
+  "    declarator: ["                                                          \
+  "      (function_declarator parameters: (parameter_list))"                   \
+  "      (pointer_declarator"                                                  \
+  "        declarator: (function_declarator"                                   \
+  "          parameters: (parameter_list)))"                                   \
+  "      (pointer_declarator"                                                  \
+  "        declarator: (pointer_declarator"                                    \
+  "          declarator: (function_declarator"                                 \
+  "            parameters: (parameter_list))))"                                \
+  "    ]) @declaration)"
+
+#define STRUCT_QUERY                                                           \
+  "(struct_specifier body: (field_declaration_list) @fields) @struct"
+
+static const gchar *const prototype_captures[] = {"declaration", NULL};
+static const gchar *const struct_captures[] = {"struct", "fields", NULL};
+
+/* Tags of the comment being checked, reused by all the comments checked on
+ * a thread so that tokenizing does not allocate */
+static GPrivate scratch_tags = G_PRIVATE_INIT((GDestroyNotify) g_array_unref);
+
+static GArray *
+get_scratch_tags(void)
+{
+  GArray *tags = g_private_get(&scratch_tags);
+
+  if (tags == NULL) {
+    tags = g_array_new(FALSE, FALSE, sizeof(struct doc_tag));
+    g_private_set(&scratch_tags, tags);
+  }
+  g_array_set_size(tags, 0);
+  return tags;
+}
+
+static gboolean
+has_tag(GArray *tags, enum doc_tag_kind kind)
+{
+  g_assert(tags);
+
+  for (guint i = 0; i < tags->len; i++) {
+    if (g_array_index(tags, struct doc_tag, i).kind == kind) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
 
 static void
 validate_return(const gchar *content,
                 TSNode n,
-                const gchar *comment,
-                GList **problems)
+                GArray *tags,
+                problems_t *problems)
 {
   TSNode ret_type;
-  struct problem *p = NULL;
-  const gchar *return_doc;
+  gboolean return_doc;
 
   g_assert(content);
-  g_assert(comment);
+  g_assert(tags);
   g_assert(problems);
 
-  ret_type = ts_node_child_by_field_name(n, "type", strlen("type"));
+  ret_type = ts_node_child_by_field_id(n, FIELD_TYPE);
 
   if (ts_node_is_null(ret_type)) {
-    p = message_problem_new(3, &n, &n, "Function should have a return value");
-    *problems = g_list_prepend(*problems, p);
+    problems_add_node(problems, RULE_COMMENT_NO_RETURN_VALUE, n, n);
     return;
   }
 
-  return_doc = g_strstr_len(comment, -1, "@return");
+  return_doc = has_tag(tags, DOC_TAG_RETURN);
 
   if (parse_utils_node_eq(content, &ret_type, "void")) {
-    if (return_doc != NULL) {
-      p = message_problem_new(3, &n, &n,
-                              "Void functions should not document @return");
-      *problems = g_list_prepend(*problems, p);
+    if (return_doc) {
+      problems_add_node(problems, RULE_COMMENT_VOID_RETURN, n, n);
     }
   } else {
-    if (return_doc == NULL) {
-      p = message_problem_new(3, &n, &n,
-                              "Functions return value should be documented "
-                              "with @return");
-      *problems = g_list_prepend(*problems, p);
+    if (!return_doc) {
+      problems_add_node(problems, RULE_COMMENT_RETURN, n, n);
     }
   }
 }
 
-static GHashTable *
-parse_param_docs(const gchar *content, const gchar *comment)
+/* Name of the identifier of param, NULL if it has none */
+static const gchar *
+param_name(const node_table_t *nodes, const struct function_param *param)
 {
-  gchar **lines = NULL;
-  GHashTable *res;
-
-  g_assert(content);
-  g_assert(comment);
+  g_assert(nodes);
+  g_assert(param);
 
-  res = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-  lines = g_strsplit(comment, "\n", -1);
-
-  for (guint i = 0; lines[i] != NULL; i++) {
-    gchar **words = NULL;
-    gboolean next = FALSE;
-    if (g_strstr_len(lines[i], -1, "@param") == NULL) {
-      continue;
-    }
-
-    words = g_strsplit(lines[i], " ", -1);
-    for (guint j = 0; words[j] != NULL; j++) {
-      if (g_strcmp0(words[j], "@param") == 0) {
-        next = TRUE;
-        continue;
-      }
-
-      if (next && strlen(words[j]) > 0) {
-        g_hash_table_add(res, g_strdup(words[j]));
-        break;
-      }
-    }
-    g_strfreev(words);
+  if (ts_node_is_null(param->ident)) {
+    return NULL;
   }
-  g_strfreev(lines);
-
-  return res;
+  return node_table_ident_name(nodes, node_table_ident(nodes, param->ident));
 }
 
-static void
-validate_arg(const gchar *content,
-             TSNode arg,
-             GHashTable *params,
-             GList **problems)
+static gboolean
+is_documented(GArray *tags, const gchar *name)
 {
-  TSNode id;
-  gboolean found;
-  gchar *name;
-
-  g_assert(content);
-  g_assert(params);
-  g_assert(problems);
-
-  id = parse_utils_get_first_node_id(arg, SYMBOL_IDENTIFIER, &found);
-
-  if (!found) {
-    return;
-  }
+  g_assert(tags);
+  g_assert(name);
 
-  name = parse_utils_node_get_string(content, &id);
+  for (guint i = 0; i < tags->len; i++) {
+    const struct doc_tag *tag = &g_array_index(tags, struct doc_tag, i);
 
-  if (!g_hash_table_remove(params, name)) {
-    struct problem *p;
-    p = message_problem_new(3, &id, &id, "Parameter %s is not documented", name);
-    *problems = g_list_prepend(*problems, p);
+    if (tag->kind == DOC_TAG_PARAM && doc_comment_arg_eq(tag, name)) {
+      return TRUE;
+    }
   }
-
-  g_free(name);
+  return FALSE;
 }
 
-static void
-validate_arg_list(const gchar *content,
-                  TSNode n,
-                  const gchar *comment,
-                  GList **problems)
+/* Whether a @param names none of the parameters */
+static gboolean
+has_extra_param(const node_table_t *nodes,
+                const struct function_info *info,
+                const struct function_param *args,
+                GArray *tags)
 {
-  GHashTable *params;
-  TSNode list;
-  gboolean found = FALSE;
+  g_assert(info);
+  g_assert(tags);
 
-  g_assert(content);
-  g_assert(comment);
-  g_assert(problems);
-
-  list = parse_utils_get_first_node_id(n, 258, &found);
-  if (!found) {
-    return;
-  }
-  params = parse_param_docs(content, comment);
+  for (guint i = 0; i < tags->len; i++) {
+    const struct doc_tag *tag = &g_array_index(tags, struct doc_tag, i);
+    gboolean known = FALSE;
 
-  for (guint i = 0; i < ts_node_named_child_count(list); i++) {
-    TSNode n = ts_node_named_child(list, i);
-    validate_arg(content, n, params, problems);
-  }
+    if (tag->kind != DOC_TAG_PARAM || tag->arg == NULL) {
+      continue;
+    }
+    for (guint j = 0; j < info->n_params && !known; j++) {
+      const gchar *name = param_name(nodes, &args[j]);
 
-  if (g_hash_table_size(params) > 0) {
-    struct problem *p;
-    p = message_problem_new(3, &list, &list, "Extra params are documented");
-    *problems = g_list_prepend(*problems, p);
+      known = name != NULL && doc_comment_arg_eq(tag, name);
+    }
+    if (!known) {
+      return TRUE;
+    }
   }
-
-  g_clear_pointer(&params, g_hash_table_unref);
+  return FALSE;
 }
 
 static void
-check_function_comments(const gchar *content, TSNode current, GList **problems)
+validate_arg_list(const node_table_t *nodes,
+                  const struct function_info *info,
+                  const struct function_param *args,
+                  GArray *tags,
+                  problems_t *problems)
 {
-  g_assert(content);
+  g_assert(nodes);
+  g_assert(info);
+  g_assert(args);
+  g_assert(tags);
   g_assert(problems);
 
-  for (guint i = 0; i < ts_node_named_child_count(current); i++) {
-    TSNode n = ts_node_named_child(current, i);
-    TSNode stat;
-    TSNode comment;
-    struct problem *p = NULL;
-    gchar *comment_str;
+  for (guint i = 0; i < info->n_params; i++) {
+    const gchar *name = param_name(nodes, &args[i]);
 
-    gboolean found = FALSE;
+    if (name != NULL && !is_documented(tags, name)) {
+      TSNode id = args[i].ident;
 
-    if (ts_node_symbol(n) != SYMBOL_DECLARATION) {
-      continue;
-    }
-
-    stat = parse_utils_get_first_node_id(n, SYMBOL_STORAGE_SPEC, &found);
-
-    if (found && (parse_utils_node_eq(content, &stat, "static") ||
-                  parse_utils_node_eq(content, &stat, "STATIC"))) {
-      /* Don't check comments for "internal" functions */
-      continue;
-    }
-
-    parse_utils_get_first_node_id(n, SYMBOL_FUNC_DECLARATION, &found);
-
-    if (!found) {
-      continue;
-    }
-
-    comment = ts_node_prev_named_sibling(n);
-    if (ts_node_symbol(comment) != SYMBOL_COMMENT) {
-      p = message_problem_new(3, &n, &n, "Function should be documented");
-      *problems = g_list_prepend(*problems, p);
-      continue;
-    }
-
-    comment_str = parse_utils_node_get_string(content, &comment);
-
-    if (g_strstr_len(comment_str, -1, "@brief") == NULL) {
-      p = message_problem_new(3, &comment, &comment,
-                              "Comment should contain a @brief");
-      *problems = g_list_prepend(*problems, p);
+      problems_add_node(problems, RULE_COMMENT_PARAM, id, id, name);
     }
+  }
 
-    validate_return(content, n, comment_str, problems);
-    validate_arg_list(content, n, comment_str, problems);
+  if (has_extra_param(nodes, info, args, tags)) {
+    TSNode list = info->param_list;
 
-    g_free(comment_str);
+    problems_add_node(problems, RULE_COMMENT_EXTRA_PARAMS, list, list);
   }
 }
 
-static gboolean
-is_post_comment(const gchar *content, TSNode c)
+static void
+check_function_comments(const gchar *content,
+                        const node_table_t *nodes,
+                        const function_table_t *functions,
+                        const struct function_info *info,
+                        problems_t *problems)
 {
-  gchar *str;
-  gboolean ret = FALSE;
+  TSNode n;
+  TSNode comment;
+  GArray *tags;
+  guint32 start;
 
   g_assert(content);
+  g_assert(functions);
+  g_assert(info);
+  g_assert(problems);
 
-  if (ts_node_is_null(c)) {
-    return ret;
+  if (info->is_static) {
+    /* Don't check comments for "internal" functions */
+    return;
   }
 
-  if (ts_node_symbol(c) != SYMBOL_COMMENT) {
-    return ret;
+  n = info->node;
+  comment = info->doc;
+  if (ts_node_is_null(comment)) {
+    problems_add_node(problems, RULE_COMMENT_FUNCTION, n, n);
+    return;
   }
 
-  str = parse_utils_node_get_string(content, &c);
+  tags = get_scratch_tags();
+  start = ts_node_start_byte(comment);
+  doc_comment_tags(content + start, ts_node_end_byte(comment) - start, tags);
 
-  if (g_str_has_prefix(str, "/**< ")) {
-    ret = TRUE;
+  if (!has_tag(tags, DOC_TAG_BRIEF)) {
+    problems_add_node(problems, RULE_COMMENT_BRIEF, comment, comment);
   }
 
-  g_free(str);
-
-  return ret;
+  validate_return(content, n, tags, problems);
+  validate_arg_list(nodes, info, function_table_params(functions, info), tags,
+                    problems);
 }
 
+/* Whether the node at index, -1 for none, is a comment starting with
+ * prefix, checked in place */
 static gboolean
-is_pre_comment(const gchar *content, TSNode c)
+is_doc_comment(const gchar *content,
+               const node_table_t *nodes,
+               gint index,
+               const gchar *prefix)
 {
-  gchar *str;
-  gboolean ret = FALSE;
+  TSNode c;
 
   g_assert(content);
-  if (ts_node_is_null(c)) {
-    return ret;
-  }
+  g_assert(prefix);
 
-  if (ts_node_symbol(c) != SYMBOL_COMMENT) {
-    return ret;
+  if (index < 0) {
+    return FALSE;
   }
-
-  str = parse_utils_node_get_string(content, &c);
-
-  if (g_str_has_prefix(str, "/** ")) {
-    ret = TRUE;
+  c = node_table_node(nodes, index);
+  if (ts_node_symbol(c) != SYMBOL_COMMENT) {
+    return FALSE;
   }
-
-  g_free(str);
-
-  return ret;
+  return ts_node_end_byte(c) - ts_node_start_byte(c) >= strlen(prefix) &&
+         parse_utils_node_eq(content, &c, prefix);
 }
 
 static void
-check_struct_comments(const gchar *content, TSNode current, GList **problems)
+check_field_comment(const gchar *content,
+                    const node_table_t *nodes,
+                    gint index,
+                    gint prev,
+                    gint next,
+                    problems_t *problems)
 {
-  TSNode fields;
+  TSNode n;
+  TSNode ident;
   gboolean found = FALSE;
 
   g_assert(content);
   g_assert(problems);
 
-  if (ts_node_symbol(current) != SYMBOL_STRUCT_SPEC) {
+  n = node_table_node(nodes, index);
+  if (ts_node_symbol(n) != SYMBOL_FIELD_DECL) {
     return;
   }
-
-  fields = parse_utils_get_first_node_id(current, SYMBOL_FIELD_DECL_LIST,
-                                          &found);
-
-  if (!found) {
+  if (is_doc_comment(content, nodes, next, "/**< ")) {
+    return;
+  }
+  if (is_doc_comment(content, nodes, prev, "/** ")) {
     return;
   }
 
-  for (guint i = 0; i < ts_node_named_child_count(fields); i++) {
-    TSNode n = ts_node_named_child(fields, i);
-    TSNode ident;
-    struct problem *p = NULL;
-
-    if (ts_node_symbol(n) != SYMBOL_FIELD_DECL) {
-      continue;
-    }
-    if (is_post_comment(content, ts_node_next_named_sibling(n))) {
-      continue;
-    }
-    if (is_pre_comment(content, ts_node_prev_named_sibling(n))) {
-      continue;
-    }
-
-    ident = parse_utils_get_first_node_id(n, SYMBOL_FIELD_IDENT, &found);
-    if (found) {
-      p = message_problem_new(3, &ident, &ident,
-                              "Struct field should be commented");
-      *problems = g_list_prepend(*problems, p);
-    }
+  ident = node_table_first(nodes, n, SYMBOL_FIELD_IDENT, &found);
+  if (found) {
+    problems_add_node(problems, RULE_COMMENT_FIELD, ident, ident);
   }
 }
 
 static void
-recurse_check(const gchar *content, TSNode p, GList **problems)
+check_struct_comments(const gchar *content,
+                      const node_table_t *nodes,
+                      TSNode fields,
+                      problems_t *problems)
 {
+  gint index;
+  gint prev = -1;
+  gint next;
+
   g_assert(content);
+  g_assert(nodes);
   g_assert(problems);
 
-  for (guint i = 0; i < ts_node_named_child_count(p); i++) {
-    TSNode n = ts_node_named_child(p, i);
+  index = node_table_index(nodes, fields);
+  if (index < 0) {
+    return;
+  }
 
-    check_struct_comments(content, n, problems);
-    recurse_check(content, n, problems);
+  /* One pass over the fields, the comments around a field are its
+   * neighbours in the table */
+  for (gint child = node_table_first_child(nodes, index); child >= 0;
+       child = next) {
+    next = node_table_next_sibling(nodes, child);
+    check_field_comment(content, nodes, child, prev, next, problems);
+    prev = child;
   }
 }
 
-GList *
-process_comments(parser_t *parser, G_GNUC_UNUSED struct process_ctx *ctx)
+static void
+match_prototype(struct visit_ctx *v,
+                const TSNode *captures,
+                G_GNUC_UNUSED gpointer user_data)
 {
-  GList *res = NULL;
-  if (parser->message->type == MESSAGE_TYPE_DIAGNOSTIC ||
-      parser->message->type == MESSAGE_TYPE_OPEN ||
-      parser->message->type == MESSAGE_TYPE_CHANGE) {
-    recurse_check(parser->content, parser->root_node, &res);
-    check_function_comments(parser->content, parser->root_node, &res);
+  const function_table_t *functions;
+  const struct function_info *info;
+
+  g_assert(v);
+  g_assert(captures);
+
+  functions = parser_get_functions(v->parser);
+  info = function_table_lookup(functions, captures[0]);
+  if (info != NULL) {
+    check_function_comments(v->parser->content, v->parser->nodes, functions,
+                            info, v->problems);
   }
-  return res;
+}
+
+static void
+match_struct(struct visit_ctx *v,
+             const TSNode *captures,
+             G_GNUC_UNUSED gpointer user_data)
+{
+  g_assert(v);
+  g_assert(captures);
+
+  check_struct_comments(v->parser->content, v->parser->nodes, captures[1],
+                        v->problems);
+}
+
+void
+process_comments_register(visitor_t *visitor, guint rule)
+{
+  g_assert(visitor);
+
+  visitor_add_query(visitor, rule, PROTOTYPE_QUERY, prototype_captures,
+                    match_prototype, NULL);
+  visitor_add_query(visitor, rule, STRUCT_QUERY, struct_captures,
+                    match_struct, NULL);
 }
@@ -6,68 +6,72 @@
 #include "parser.h"
 #include "process_midscope.h"
 #include "processor.h"
+#include "visitor.h"
+
+/* Body should be anything within { ... } */
+#define BODY_QUERY "(compound_statement) @body"
+
+static const gchar *const body_captures[] = {"body", NULL};
 
 static void
-check_midscope(const gchar *content, TSNode current, GList **problems)
+check_midscope(const gchar *content,
+               const node_table_t *nodes,
+               TSNode current,
+               problems_t *problems)
 {
+  TSTreeCursor cursor;
   gboolean other = FALSE;
 
   g_assert(content);
   g_assert(problems);
 
-  if (ts_node_symbol(current) != SYMBOL_BODY) {
-    /* Body should be anything within { ... } */
-    return;
+  cursor = ts_tree_cursor_new(current);
+  if (!parse_utils_cursor_first_named_child(&cursor)) {
+    goto out;
   }
-
-  for (guint i = 0; i < ts_node_named_child_count(current); i++) {
-    TSNode n = ts_node_named_child(current, i);
-    struct problem *p;
+  do {
+    TSNode n = ts_tree_cursor_current_node(&cursor);
 
     if (ts_node_symbol(n) == SYMBOL_DECLARATION) {
       if (other == TRUE) {
         gboolean found;
         TSNode symbol;
 
-        symbol = parse_utils_get_first_node_id(n, SYMBOL_IDENTIFIER, &found);
+        symbol = node_table_first(nodes, n, SYMBOL_IDENTIFIER, &found);
 
         if (!found) {
           continue;
         }
 
-        p = message_problem_new(3, &symbol, &symbol,
-                                "Declares should be done at the start of a "
-                                "body");
-        *problems = g_list_prepend(*problems, p);
+        problems_add_node(problems, RULE_MIDSCOPE_DECLARATION, symbol, symbol);
       }
     } else {
       other = TRUE;
     }
-  }
+  } while (parse_utils_cursor_next_named_sibling(&cursor));
+
+  /* Fall through */
+out:
+  ts_tree_cursor_delete(&cursor);
 }
 
 static void
-recurse_check(const gchar *content, TSNode p, GList **problems)
+match_body(struct visit_ctx *v,
+           const TSNode *captures,
+           G_GNUC_UNUSED gpointer user_data)
 {
-  g_assert(content);
-  g_assert(problems);
-
-  for (guint i = 0; i < ts_node_named_child_count(p); i++) {
-    TSNode n = ts_node_named_child(p, i);
+  g_assert(v);
+  g_assert(captures);
 
-    check_midscope(content, n, problems);
-    recurse_check(content, n, problems);
-  }
+  check_midscope(v->parser->content, v->parser->nodes, captures[0],
+                 v->problems);
 }
 
-GList *
-process_midscope(parser_t *parser, G_GNUC_UNUSED struct process_ctx *ctx)
+void
+process_midscope_register(visitor_t *visitor, guint rule)
 {
-  GList *res = NULL;
-  if (parser->message->type == MESSAGE_TYPE_DIAGNOSTIC ||
-      parser->message->type == MESSAGE_TYPE_OPEN ||
-      parser->message->type == MESSAGE_TYPE_CHANGE) {
-    recurse_check(parser->content, parser->root_node, &res);
-  }
-  return res;
+  g_assert(visitor);
+
+  visitor_add_query(visitor, rule, BODY_QUERY, body_captures, match_body,
+                    NULL);
 }
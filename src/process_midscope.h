@@ -3,7 +3,6 @@
 
 #include "parser.h"
 #include "processor.h"
+#include "visitor.h"
 
-GList *
-process_midscope(parser_t *parser, struct process_ctx *ctx);
-
+void process_midscope_register(visitor_t *visitor, guint rule);
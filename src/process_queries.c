@@ -0,0 +1,352 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+#include <tree_sitter/api.h>
+
+#include "message.h"
+#include "parser.h"
+#include "process_queries.h"
+#include "processor.h"
+#include "rules.h"
+#include "visitor.h"
+
+/* Severity of rules that do not say, like the built in ones */
+#define DEFAULT_SEVERITY 3
+
+struct query {
+  enum rule_id id;
+  gchar *code;
+  gint severity;
+  /* Message with a %s for every placeholder */
+  gchar *message;
+  gchar *pattern;
+  /* The capture reported, then those of the placeholders in order */
+  gchar **captures;
+};
+
+/* struct query, set once at startup and read only after */
+static GPtrArray *queries = NULL;
+
+/* The file the rules were read from, for telling the client about it */
+static struct {
+  GMutex lock;
+  gchar *path;
+  /* Modification time (s) when it was read, -1 if there was none */
+  gint64 mtime;
+  /* Why the rules were not loaded */
+  gchar *error;
+} source;
+
+G_DEFINE_QUARK("process-queries-error-quark", process_queries_error)
+
+static void
+query_free(gpointer data)
+{
+  struct query *q = (struct query *) data;
+
+  if (q == NULL) {
+    return;
+  }
+  g_free(q->code);
+  g_free(q->message);
+  g_free(q->pattern);
+  g_strfreev(q->captures);
+  g_free(q);
+}
+
+static const gchar *
+string_member(JsonObject *obj, const gchar *name, GError **err)
+{
+  JsonNode *node = json_object_get_member(obj, name);
+
+  if (node == NULL || !JSON_NODE_HOLDS_VALUE(node) ||
+      json_node_get_value_type(node) != G_TYPE_STRING) {
+    g_set_error(err, PROCESS_QUERIES_ERROR, -1, "Should have a string %s",
+                name);
+    return NULL;
+  }
+  return json_node_get_string(node);
+}
+
+/* Turns the {name} placeholders of message into %s, adding the names to
+ * captures */
+static gchar *
+parse_message(const gchar *message, GPtrArray *captures, GError **err)
+{
+  GString *res;
+  const gchar *open;
+
+  if (strstr(message, "%s") != NULL) {
+    g_set_error(err, PROCESS_QUERIES_ERROR, -1,
+                "Message should not hold %%s, use {capture}");
+    return NULL;
+  }
+
+  res = g_string_new(NULL);
+  while ((open = strchr(message, '{')) != NULL) {
+    const gchar *close = strchr(open, '}');
+
+    if (close == NULL || close == open + 1) {
+      g_set_error(err, PROCESS_QUERIES_ERROR, -1,
+                  "Message has an invalid placeholder at: %.20s", open);
+      g_string_free(res, TRUE);
+      return NULL;
+    }
+    g_string_append_len(res, message, open - message);
+    g_string_append(res, "%s");
+    g_ptr_array_add(captures, g_strndup(open + 1, close - open - 1));
+    message = close + 1;
+  }
+  g_string_append(res, message);
+
+  return g_string_free(res, FALSE);
+}
+
+static gboolean
+code_taken(const gchar *code, GPtrArray *loaded)
+{
+  for (guint i = 0; i < rules_count(); i++) {
+    if (g_str_equal(rules_get(i)->code, code)) {
+      return TRUE;
+    }
+  }
+  for (guint i = 0; i < loaded->len; i++) {
+    struct query *q = g_ptr_array_index(loaded, i);
+
+    if (g_str_equal(q->code, code)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static struct query *
+parse_rule(JsonObject *obj, GPtrArray *loaded, GError **err)
+{
+  struct query *q;
+  GPtrArray *captures;
+  JsonNode *severity;
+  const gchar *code;
+  const gchar *pattern;
+  const gchar *capture;
+  const gchar *message;
+
+  g_assert(obj);
+  g_assert(loaded);
+
+  if ((code = string_member(obj, "code", err)) == NULL ||
+      (pattern = string_member(obj, "query", err)) == NULL ||
+      (capture = string_member(obj, "capture", err)) == NULL ||
+      (message = string_member(obj, "message", err)) == NULL) {
+    return NULL;
+  }
+  if (code_taken(code, loaded)) {
+    g_set_error(err, PROCESS_QUERIES_ERROR, -1, "Code %s is already used",
+                code);
+    return NULL;
+  }
+
+  q = g_new0(struct query, 1);
+  q->code = g_strdup(code);
+  q->pattern = g_strdup(pattern);
+  q->severity = DEFAULT_SEVERITY;
+  severity = json_object_get_member(obj, "severity");
+  if (severity != NULL) {
+    if (!JSON_NODE_HOLDS_VALUE(severity) ||
+        json_node_get_value_type(severity) != G_TYPE_INT64 ||
+        json_node_get_int(severity) < 1 || json_node_get_int(severity) > 4) {
+      g_set_error(err, PROCESS_QUERIES_ERROR, -1,
+                  "Severity should be from 1 to 4");
+      goto fail;
+    }
+    q->severity = json_node_get_int(severity);
+  }
+
+  captures = g_ptr_array_new();
+  g_ptr_array_add(captures, g_strdup(capture));
+  q->message = parse_message(message, captures, err);
+  g_ptr_array_add(captures, NULL);
+  q->captures = (gchar **) g_ptr_array_free(captures, FALSE);
+  if (q->message == NULL) {
+    goto fail;
+  }
+
+  if (!visitor_query_check(q->pattern, (const gchar *const *) q->captures,
+                           err)) {
+    goto fail;
+  }
+  return q;
+
+fail:
+  query_free(q);
+  return NULL;
+}
+
+/* Modification time of path in seconds, -1 if it does not exist */
+static gint64
+modified(const gchar *path)
+{
+  GStatBuf buf;
+
+  if (g_stat(path, &buf) != 0) {
+    return -1;
+  }
+  return buf.st_mtime;
+}
+
+/* Remembers what was read, for process_queries_notices() */
+static void
+set_source(const gchar *path, const GError *error)
+{
+  g_mutex_lock(&source.lock);
+  g_free(source.path);
+  source.path = g_strdup(path);
+  source.mtime = modified(path);
+  g_free(source.error);
+  source.error = error != NULL ? g_strdup(error->message) : NULL;
+  g_mutex_unlock(&source.lock);
+}
+
+gboolean
+process_queries_load(const gchar *path, GError **err)
+{
+  JsonParser *parser;
+  JsonNode *root;
+  JsonNode *rules;
+  GPtrArray *loaded;
+  GError *lerr = NULL;
+  gboolean res = FALSE;
+
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+  g_return_val_if_fail(queries == NULL, FALSE);
+
+  parser = json_parser_new();
+  loaded = g_ptr_array_new_with_free_func(query_free);
+  if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+    /* No rules */
+    res = TRUE;
+    goto out;
+  }
+  if (!json_parser_load_from_file(parser, path, &lerr)) {
+    goto out;
+  }
+
+  root = json_parser_get_root(parser);
+  rules = NULL;
+  if (root != NULL && JSON_NODE_HOLDS_OBJECT(root)) {
+    rules = json_object_get_member(json_node_get_object(root), "rules");
+  }
+  if (rules == NULL || !JSON_NODE_HOLDS_ARRAY(rules)) {
+    g_set_error(&lerr, PROCESS_QUERIES_ERROR, -1,
+                "%s should hold an object with a rules array", path);
+    goto out;
+  }
+
+  for (guint i = 0; i < json_array_get_length(json_node_get_array(rules));
+       i++) {
+    JsonNode *node = json_array_get_element(json_node_get_array(rules), i);
+    struct query *q = NULL;
+
+    if (!JSON_NODE_HOLDS_OBJECT(node)) {
+      g_set_error(&lerr, PROCESS_QUERIES_ERROR, -1, "Should be an object");
+    } else {
+      q = parse_rule(json_node_get_object(node), loaded, &lerr);
+    }
+    if (q == NULL) {
+      g_prefix_error(&lerr, "%s: rule %u: ", path, i);
+      goto out;
+    }
+    g_ptr_array_add(loaded, q);
+  }
+
+  /* Only once all are valid, ids can not be taken back */
+  for (guint i = 0; i < loaded->len; i++) {
+    struct query *q = g_ptr_array_index(loaded, i);
+
+    q->id = rules_add(q->code, q->severity, q->message,
+                      g_strv_length(q->captures) - 1);
+  }
+  queries = g_steal_pointer(&loaded);
+  res = TRUE;
+
+  /* Fall through */
+out:
+  set_source(path, lerr);
+  if (lerr != NULL) {
+    g_propagate_error(err, lerr);
+  }
+  if (loaded != NULL) {
+    g_ptr_array_unref(loaded);
+  }
+  g_object_unref(parser);
+  return res;
+}
+
+guint
+process_queries_count(void)
+{
+  return queries != NULL ? queries->len : 0;
+}
+
+GList *
+process_queries_notices(parser_t *parser, G_GNUC_UNUSED struct process_ctx *ctx)
+{
+  GList *list = NULL;
+  gchar *text = NULL;
+  gint type = MESSAGE_SHOW_INFO;
+
+  g_return_val_if_fail(parser != NULL, NULL);
+
+  g_mutex_lock(&source.lock);
+  if (parser->message->type == MESSAGE_TYPE_INITIALIZED &&
+      source.error != NULL) {
+    type = MESSAGE_SHOW_ERROR;
+    text = g_strdup_printf("Rules not loaded: %s", source.error);
+  }
+  /* Rules are only read at startup, the client is told to restart once the
+   * file changed */
+  if (parser->message->type == MESSAGE_TYPE_CONFIGURATION &&
+      source.path != NULL && modified(source.path) != source.mtime) {
+    source.mtime = modified(source.path);
+    text = g_strdup_printf("%s changed, restart the server to use its rules",
+                           source.path);
+  }
+  g_mutex_unlock(&source.lock);
+
+  if (text != NULL) {
+    list = g_list_prepend(list, message_show(type, text));
+    g_free(text);
+  }
+  return list;
+}
+
+static void
+match_query(struct visit_ctx *v, const TSNode *captures, gpointer user_data)
+{
+  struct query *q = (struct query *) user_data;
+
+  g_assert(v);
+  g_assert(captures);
+  g_assert(q);
+
+  if (ts_node_is_null(captures[0])) {
+    return;
+  }
+  problems_add_node_texts(v->problems, q->id, captures[0], captures[0],
+                          v->parser->content, captures + 1);
+}
+
+void
+process_queries_register(visitor_t *visitor, guint rule)
+{
+  g_assert(visitor);
+
+  for (guint i = 0; i < process_queries_count(); i++) {
+    struct query *q = g_ptr_array_index(queries, i);
+
+    visitor_add_query(visitor, rule, q->pattern,
+                      (const gchar *const *) q->captures, match_query, q);
+  }
+}
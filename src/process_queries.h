@@ -0,0 +1,36 @@
+#include <glib.h>
+
+#include "parser.h"
+#include "processor.h"
+#include "visitor.h"
+
+/* Rules of the user, read from a file:
+ *
+ * {"rules": [{"code": "project.no-strcpy",
+ *             "query": "((call_expression function: (identifier) @fn) @call
+ *                        (#eq? @fn \"strcpy\"))",
+ *             "capture": "call",
+ *             "message": "Use g_strlcpy instead of {fn}",
+ *             "severity": 2}]}
+ *
+ * Every match of query is reported on capture, the {name} placeholders of
+ * message get the text of the capture name. severity is the LSP one and
+ * defaults to 3. */
+#define PROCESS_QUERIES_ERROR process_queries_error_quark()
+
+/* Loads and checks all rules of path, none of them when one is invalid. A
+ * missing path holds no rules. Call once at startup, before registering,
+ * a changed file is only read again by a restart. */
+gboolean process_queries_load(const gchar *path, GError **err);
+
+/* Tells the client why the rules were not loaded once it is initialized, and
+ * that a restart is needed when the configuration changes after the file
+ * did */
+GList *process_queries_notices(parser_t *parser, struct process_ctx *ctx);
+
+/* Number of rules loaded */
+guint process_queries_count(void);
+
+void process_queries_register(visitor_t *visitor, guint rule);
+
+GQuark process_queries_error_quark(void);
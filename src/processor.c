@@ -1,71 +1,1328 @@
 #include <gio/gio.h>
 #include <glib.h>
+#include <time.h>
 
+#include "cpus.h"
+#include "function_cache.h"
 #include "message.h"
+#include "parse_utils.h"
 #include "parser.h"
 #include "processor.h"
+#include "result_store.h"
 #include "rpc.h"
+#include "summary_store.h"
+#include "visitor.h"
 
-#define MAX_THREADS 10
+/* The worker load average is kept in 1/LOAD_SCALE workers */
+#define LOAD_SCALE 16
+
+/* Files at least this large are split into units analyzed in parallel */
+#define PARALLEL_MIN_BYTES (64 * 1024)
+/* A unit ends with the first function definition after this many bytes */
+#define UNIT_MIN_BYTES (8 * 1024)
+/* Past this share of the file changed (1/n), the whole file is analyzed */
+#define CHANGED_MAX_SHARE 2
+
+/* Expensive rules run once a changed file has been left alone this long */
+#define IDLE_DELAY (2 * G_TIME_SPAN_SECOND)
+
+#define ALL_TIERS ((1u << PROCESS_TIER_COUNT) - 1)
+
+/* Wall time a rule may spend on one analysis of a document */
+#define CHEAP_BUDGET     (50 * G_TIME_SPAN_MILLISECOND)
+#define EXPENSIVE_BUDGET (500 * G_TIME_SPAN_MILLISECOND)
+/* Overruns in a row before a rule is disabled for the document */
+#define BUDGET_STRIKES 3
+/* A disabled rule runs again once edits replaced this share (1/n) of the
+ * document it was disabled on */
+#define BUDGET_REARM_SHARE 4
+
+/* Top level declarations whose problems are remembered across analyses */
+#define FUNCTION_CACHE_ENTRIES 16384
 
 struct proc_ctx {
+  const gchar *name;
+  /* Called once per analysis, NULL for rules living in the visitor */
   process_func_t func;
+  enum process_tier tier;
   gpointer user_data;
 };
 
+/* Time budget of a rule for one document, protected by file_lock */
+struct budget {
+  guint overruns;
+  gboolean disabled;
+  /* Size of the document when the rule was disabled */
+  gsize disabled_size;
+  /* Bytes edited since */
+  gsize edited;
+};
+
+/* One tier of one analysis */
+struct tier_run {
+  enum process_tier tier;
+  /* Rules disabled for the document, indexed like the processors */
+  gboolean *disabled;
+  /* Wall time (us) spent by every rule */
+  gint64 *times;
+  /* Answers of the processes, sent as they are */
+  GList *responses;
+};
+
+/* Per file state, protected by file_lock */
+struct document {
+  /* Cancellable of the newest analysis */
+  GCancellable *analysis;
+  /* CPU time (us) of the last analysis that ran to the end */
+  gint64 cpu_time;
+  /* Newest version seen in didOpen/didChange */
+  gint64 version;
+  /* Newest results of every tier and the version they belong to */
+  problems_t *tier_results[PROCESS_TIER_COUNT];
+  gint64 tier_version[PROCESS_TIER_COUNT];
+  /* When to run the expensive tier unless the file changes, 0 if not due */
+  gint64 idle_deadline;
+  /* struct budget of every rule */
+  GArray *budgets;
+  /* Newest version analyzed while a rule is disabled, edits are measured
+   * from it */
+  parser_t *seen;
+  /* Last complete analysis of every tier and the problems its rules found,
+   * only what changed since is analyzed again */
+  parser_t *base[PROCESS_TIER_COUNT];
+  problems_t *base_problems[PROCESS_TIER_COUNT];
+  /* problems_hash() of the diagnostics last published, if any were */
+  gboolean published;
+  guint64 published_hash;
+};
+
+enum job_priority {
+  /* Client requests carrying an id, someone is waiting for the answer */
+  JOB_PRIORITY_REQUEST = 0,
+  /* Analyses triggered by notifications */
+  JOB_PRIORITY_NOTIFICATION,
+  /* Background and indexing work */
+  JOB_PRIORITY_BACKGROUND,
+};
+
+struct job {
+  parser_t *parser;
+  enum job_priority priority;
+  /* Keeps the queue FIFO within a priority */
+  gint seq;
+  /* Monotonic time when the job was queued */
+  gint64 queued;
+};
+
+/* Units of one file, taken in order by whichever worker is free */
+struct unit_batch {
+  processor_t *ctx;
+  /* Units run side by side, the wall time of a rule is the longest any
+   * worker spent on it. Protected by lock. */
+  struct tier_run *run;
+  /* parser_t units in position order */
+  GPtrArray *units;
+  /* Problems of every unit, indexed like units */
+  problems_t **results;
+  /* Next unit to take, atomic */
+  gint next;
+  /* Units not yet finished, protected by lock */
+  guint pending;
+  GMutex lock;
+  GCond done;
+};
+
 struct processor {
   GOutputStream *out;
   GAsyncQueue *messages;
   GThreadPool *pool;
+  /* Helpers for analyzing units of large files */
+  GThreadPool *unit_pool;
   GThread *writer;
+  /* Queues the expensive tier for files that went idle */
+  GThread *idle;
   GPtrArray *processors;
+  /* Tree rules of all processors, walked once per analysis */
+  visitor_t *visitor;
+  /* The queries of visitor are compiled, no rule can be added anymore */
+  gboolean compiled;
   GHashTable *files;
+  GHashTable *documents;
+  /* Cancellables of the pending requests, by request id */
+  GHashTable *requests;
+  /* Diagnostics by (uri, version) */
+  result_store_t *results;
+  /* Problems by top level declaration, for all documents */
+  function_cache_t *functions;
+  /* What the functions of all documents assert */
+  summary_store_t *summaries;
+  gint job_seq;
+  /* Workers currently running a job */
+  gint busy;
+  /* Pool sizing, protected by pool_lock */
+  guint min_workers;
+  guint max_workers;
+  guint workers;
+  guint load;
+  GMutex pool_lock;
   GMutex file_lock;
+  /* Signalled when an idle deadline is set */
   GCond file_cond;
+  struct processor_stats stats;
 };
 
+static void
+document_free(gpointer data)
+{
+  struct document *doc = (struct document *) data;
+
+  if (doc == NULL) {
+    return;
+  }
+  g_clear_object(&doc->analysis);
+  for (guint i = 0; i < PROCESS_TIER_COUNT; i++) {
+    problems_free(doc->tier_results[i]);
+    parser_unref(doc->base[i]);
+    problems_free(doc->base_problems[i]);
+  }
+  if (doc->budgets != NULL) {
+    g_array_unref(doc->budgets);
+  }
+  parser_unref(doc->seen);
+  g_free(doc);
+}
+
+static gint64
+thread_cpu_time(void)
+{
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static void
+account_analysis(processor_t *ctx,
+                 parser_t *parser,
+                 gint64 cpu_time,
+                 gboolean incremental)
+{
+  struct document *doc;
+  gint64 saved = 0;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  if (parser->file == NULL ||
+      parser->message->type == MESSAGE_TYPE_DIAGNOSTIC) {
+    /* Requests are cancelled by the client, not by newer versions */
+    return;
+  }
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  if (!parser_is_cancelled(parser)) {
+    struct function_cache_stats functions;
+
+    ctx->stats.analyses++;
+    ctx->stats.incremental += incremental;
+    if (doc != NULL) {
+      doc->cpu_time = cpu_time;
+    }
+    function_cache_get_stats(ctx->functions, &functions);
+    g_message("Analyzed %s version %ld in %ld us, function cache hit rate "
+              "%.1f%% (%lu of %lu)",
+              parser->file, parser->version, cpu_time,
+              functions.lookups ? 100.0 * functions.hits / functions.lookups
+                                : 0.0,
+              functions.hits, functions.lookups);
+  } else {
+    /* Estimate the saving from the cost of the last complete analysis */
+    if (doc != NULL && doc->cpu_time > cpu_time) {
+      saved = doc->cpu_time - cpu_time;
+    }
+    ctx->stats.cancelled++;
+    ctx->stats.cancelled_cpu_time += cpu_time;
+    ctx->stats.saved_cpu_time += saved;
+    g_message("Cancelled analysis of %s version %ld after %ld us, %lu "
+              "cancelled in total saving ~%ld us of CPU time",
+              parser->file, parser->version, cpu_time, ctx->stats.cancelled,
+              ctx->stats.saved_cpu_time);
+  }
+  g_mutex_unlock(&ctx->file_lock);
+}
+
+static void
+answer_request(processor_t *ctx, struct job *job, gchar *msg)
+{
+  gint64 id;
+  gint64 latency;
+
+  g_assert(ctx);
+  g_assert(job);
+  g_assert(msg);
+
+  id = job->parser->message->data.diagnostic.id;
+  latency = g_get_monotonic_time() - job->queued;
+
+  g_mutex_lock(&ctx->file_lock);
+  g_hash_table_remove(ctx->requests, &id);
+  if (parser_is_cancelled(job->parser)) {
+    ctx->stats.requests_cancelled++;
+  } else {
+    ctx->stats.requests++;
+    ctx->stats.request_latency += latency;
+    ctx->stats.max_request_latency = MAX(ctx->stats.max_request_latency,
+                                         latency);
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  g_message("Answered request %ld after %ld us", id, latency);
+  g_async_queue_push(ctx->messages, msg);
+}
+
+/* Sizes the pool after the queue depth and the average number of busy
+ * workers, within the configured limits */
+static void
+adapt_pool(processor_t *ctx)
+{
+  guint queued;
+  guint busy;
+  guint target;
+
+  g_assert(ctx);
+
+  queued = g_thread_pool_unprocessed(ctx->pool);
+  busy = g_atomic_int_get(&ctx->busy);
+
+  g_mutex_lock(&ctx->pool_lock);
+  ctx->load = (ctx->load * 7 + busy * LOAD_SCALE) / 8;
+  target = MAX(busy + queued, (ctx->load + LOAD_SCALE - 1) / LOAD_SCALE);
+  target = CLAMP(target, ctx->min_workers, ctx->max_workers);
+  if (target != ctx->workers) {
+    g_debug("Resizing worker pool %u -> %u (%u busy, %u queued)",
+              ctx->workers, target, busy, queued);
+    ctx->workers = target;
+    g_thread_pool_set_max_threads(ctx->pool, target, NULL);
+  }
+  g_mutex_unlock(&ctx->pool_lock);
+}
+
+static void
+set_worker_limits(processor_t *ctx, gint64 min_workers, gint64 max_workers)
+{
+  g_assert(ctx);
+
+  g_mutex_lock(&ctx->pool_lock);
+  if (max_workers > 0) {
+    ctx->max_workers = MIN(max_workers, G_MAXINT);
+  }
+  if (min_workers > 0) {
+    ctx->min_workers = MIN(min_workers, G_MAXINT);
+  }
+  ctx->max_workers = MAX(ctx->max_workers, ctx->min_workers);
+  g_message("Worker pool limits: %u - %u", ctx->min_workers,
+            ctx->max_workers);
+  g_thread_pool_set_max_threads(ctx->unit_pool, ctx->max_workers, NULL);
+  g_mutex_unlock(&ctx->pool_lock);
+
+  adapt_pool(ctx);
+}
+
+static void
+run_processors(processor_t *ctx,
+               parser_t *parser,
+               struct tier_run *run,
+               problems_t *dia)
+{
+  gboolean *visit;
+  gboolean any = FALSE;
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(run);
+
+  visit = g_new0(gboolean, ctx->processors->len);
+
+  for (guint i = 0; i < ctx->processors->len && !parser_is_cancelled(parser);
+       i++) {
+    struct proc_ctx *current;
+    GList *resp;
+    gint64 start;
+
+    current = g_ptr_array_index(ctx->processors, i);
+    if (current->tier != run->tier || run->disabled[i]) {
+      continue;
+    }
+    if (current->func == NULL) {
+      visit[i] = TRUE;
+      any = TRUE;
+      continue;
+    }
+    start = g_get_monotonic_time();
+    resp = current->func(parser, current->user_data);
+    run->times[i] += g_get_monotonic_time() - start;
+    run->responses = g_list_concat(run->responses, resp);
+  }
+
+  if (any && !parser_is_cancelled(parser)) {
+    /* One walk for every tree rule of the tier */
+    visitor_run(ctx->visitor, parser, visit, run->times, dia);
+  }
+
+  g_free(visit);
+}
+
+static void
+unit_batch_clear(gpointer data)
+{
+  struct unit_batch *batch = (struct unit_batch *) data;
+
+  for (guint i = 0; i < batch->units->len; i++) {
+    problems_free(batch->results[i]);
+  }
+  g_ptr_array_unref(batch->units);
+  g_free(batch->results);
+  g_mutex_clear(&batch->lock);
+  g_cond_clear(&batch->done);
+}
+
+static void
+run_units(struct unit_batch *batch)
+{
+  guint rules;
+  gint64 *times;
+  gint i;
+
+  g_assert(batch);
+
+  rules = batch->ctx->processors->len;
+  /* Time of every rule over the units this worker took, one after the
+   * other */
+  times = g_new0(gint64, rules);
+
+  while ((i = g_atomic_int_add(&batch->next, 1)) < (gint) batch->units->len) {
+    problems_t *res = problems_new();
+    struct tier_run run = *batch->run;
+
+    run.times = times;
+    run.responses = NULL;
+    run_processors(batch->ctx, g_ptr_array_index(batch->units, i), &run, res);
+
+    /* Before the unit counts as done, the caller reads the times then */
+    g_mutex_lock(&batch->lock);
+    for (guint r = 0; r < rules; r++) {
+      batch->run->times[r] = MAX(batch->run->times[r], times[r]);
+    }
+    batch->run->responses = g_list_concat(batch->run->responses,
+                                          run.responses);
+    batch->results[i] = res;
+    batch->pending--;
+    if (batch->pending == 0) {
+      g_cond_signal(&batch->done);
+    }
+    g_mutex_unlock(&batch->lock);
+  }
+  g_free(times);
+}
+
+static void
+unit_worker(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+  struct unit_batch *batch = (struct unit_batch *) data;
+
+  run_units(batch);
+  g_atomic_rc_box_release_full(batch, unit_batch_clear);
+}
+
+/* Splits the top level of the file after function definitions */
+static GPtrArray *
+split_units(parser_t *parser)
+{
+  GPtrArray *units;
+  TSTreeCursor cursor;
+  guint count;
+  guint start = 0;
+  guint32 start_byte = 0;
+
+  g_assert(parser);
+
+  units = g_ptr_array_new_with_free_func((GDestroyNotify) parser_unref);
+  count = parser_unit_end(parser);
+
+  cursor = ts_tree_cursor_new(parser->root_node);
+  if (!parse_utils_cursor_first_named_child(&cursor)) {
+    count = 0;
+  }
+  for (guint i = 0; i < count; i++) {
+    TSNode n = ts_tree_cursor_current_node(&cursor);
+
+    if (ts_node_symbol(n) == SYMBOL_FUNCTION &&
+        ts_node_end_byte(n) - start_byte >= UNIT_MIN_BYTES) {
+      g_ptr_array_add(units, parser_unit_new(parser, start, i + 1));
+      start = i + 1;
+      start_byte = ts_node_end_byte(n);
+    }
+    if (!parse_utils_cursor_next_named_sibling(&cursor)) {
+      break;
+    }
+  }
+  ts_tree_cursor_delete(&cursor);
+
+  if (start < count) {
+    g_ptr_array_add(units, parser_unit_new(parser, start, count));
+  }
+
+  return units;
+}
+
+static gsize
+content_size(parser_t *parser)
+{
+  return parser->content_len;
+}
+
+/* Runs all processors over the units of a large file on as many workers as
+ * are free, the calling worker takes part so it never waits idle */
+static void
+run_processors_parallel(processor_t *ctx,
+                        parser_t *parser,
+                        struct tier_run *run,
+                        problems_t *dia)
+{
+  struct unit_batch *batch;
+  GPtrArray *units;
+  guint helpers;
+  gint64 start;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  if (parser->tree == NULL || content_size(parser) < PARALLEL_MIN_BYTES) {
+    run_processors(ctx, parser, run, dia);
+    return;
+  }
+
+  units = split_units(parser);
+  if (units->len < 2) {
+    g_ptr_array_unref(units);
+    run_processors(ctx, parser, run, dia);
+    return;
+  }
+
+  start = g_get_monotonic_time();
+  batch = g_atomic_rc_box_new0(struct unit_batch);
+  batch->ctx = ctx;
+  batch->run = run;
+  batch->units = units;
+  batch->results = g_new0(problems_t *, units->len);
+  batch->pending = units->len;
+  g_mutex_init(&batch->lock);
+  g_cond_init(&batch->done);
+
+  helpers = MIN(units->len - 1, cpus_available());
+  for (guint i = 0; i < helpers; i++) {
+    g_atomic_rc_box_acquire(batch);
+    if (!g_thread_pool_push(ctx->unit_pool, batch, NULL)) {
+      g_atomic_rc_box_release_full(batch, unit_batch_clear);
+      break;
+    }
+  }
+
+  run_units(batch);
+
+  g_mutex_lock(&batch->lock);
+  while (batch->pending > 0) {
+    g_cond_wait(&batch->done, &batch->lock);
+  }
+  g_mutex_unlock(&batch->lock);
+
+  for (guint i = 0; i < units->len; i++) {
+    problems_append(dia, batch->results[i]);
+  }
+
+  g_message("Analyzed %s as %u units in %ld us", parser->file, units->len,
+            g_get_monotonic_time() - start);
+
+  g_atomic_rc_box_release_full(batch, unit_batch_clear);
+}
+
+/* Takes a reference to the base of tier and copies of its problems, NULL if
+ * there is none */
+static parser_t *
+get_base(processor_t *ctx,
+         parser_t *parser,
+         enum process_tier tier,
+         problems_t **problems)
+{
+  struct document *doc;
+  parser_t *base = NULL;
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(problems);
+
+  if (parser->file == NULL || parser->content == NULL) {
+    return NULL;
+  }
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  if (doc != NULL && doc->base[tier] != NULL) {
+    base = parser_ref(doc->base[tier]);
+    *problems = problems_copy(doc->base_problems[tier]);
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  return base;
+}
+
+/* Makes parser the base of tier unless a newer version already is, takes
+ * problems. NULL parser drops the base. */
+static void
+set_base(processor_t *ctx,
+         const gchar *file,
+         parser_t *parser,
+         enum process_tier tier,
+         problems_t *problems)
+{
+  struct document *doc;
+
+  g_assert(ctx);
+  g_assert(file);
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, file);
+  /* A cancelled analysis may belong to a session that was reopened since */
+  if (doc != NULL &&
+      (parser == NULL ||
+       (!parser_is_cancelled(parser) &&
+        (doc->base[tier] == NULL ||
+         parser->version >= doc->base[tier]->version)))) {
+    parser_unref(doc->base[tier]);
+    problems_free(doc->base_problems[tier]);
+    doc->base[tier] = parser != NULL ? parser_ref(parser) : NULL;
+    doc->base_problems[tier] = problems;
+    problems = NULL;
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  problems_free(problems);
+}
+
+static gint
+compare_point(TSPoint a, TSPoint b)
+{
+  if (a.row != b.row) {
+    return a.row < b.row ? -1 : 1;
+  }
+  if (a.column != b.column) {
+    return a.column < b.column ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Moves p past the edit, FALSE if it started in the edited text */
+static gboolean
+shift_problem(struct problem *p, const TSInputEdit *edit)
+{
+  TSPoint start = {p->start_line, p->start_char};
+  const TSPoint *old_end = &edit->old_end_point;
+  const TSPoint *new_end = &edit->new_end_point;
+
+  if (compare_point(start, edit->start_point) < 0) {
+    return TRUE;
+  }
+  if (compare_point(start, *old_end) < 0) {
+    return FALSE;
+  }
+
+  /* Unsigned arithmetic wraps back for rows and columns that shrank */
+  if (p->start_line == old_end->row) {
+    p->start_char += new_end->column - old_end->column;
+  }
+  if (p->end_line == old_end->row) {
+    p->end_char += new_end->column - old_end->column;
+  }
+  p->start_line += new_end->row - old_end->row;
+  p->end_line += new_end->row - old_end->row;
+
+  return TRUE;
+}
+
+/* Drops the problems of old that start inside the analyzed regions and moves
+ * the others to their new position */
+static void
+keep_unchanged(problems_t *old, const TSInputEdit *edit, GArray *regions)
+{
+  guint n = 0;
+
+  for (guint i = 0; i < problems_len(old); i++) {
+    struct problem *p = problems_get(old, i);
+    gboolean keep = shift_problem(p, edit);
+    TSPoint start = {p->start_line, p->start_char};
+
+    for (guint r = 0; keep && r < regions->len; r++) {
+      TSRange *range = &g_array_index(regions, TSRange, r);
+
+      keep = compare_point(start, range->start_point) < 0 ||
+             compare_point(start, range->end_point) > 0;
+    }
+    if (keep) {
+      /* The messages of dropped problems stay in the text until it is
+       * freed */
+      *problems_get(old, n++) = *p;
+    }
+  }
+  g_array_set_size(old->items, n);
+}
+
+/* Whether a rule of the run looks at something outside of the unchanged
+ * top level node [start, start + len) that differs from base, where the
+ * node started at old_start */
+static gboolean
+context_changed(processor_t *ctx,
+                struct tier_run *run,
+                parser_t *base,
+                parser_t *parser,
+                guint32 old_start,
+                guint32 start,
+                guint32 len)
+{
+  for (guint i = 0; i < ctx->processors->len; i++) {
+    struct proc_ctx *current = g_ptr_array_index(ctx->processors, i);
+
+    if (current->tier != run->tier || current->func != NULL) {
+      continue;
+    }
+    if (visitor_context(ctx->visitor, i, base, old_start, old_start + len) !=
+        visitor_context(ctx->visitor, i, parser, start, start + len)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Units of the runs of top level nodes overlapping ranges, or following one
+ * since their doc comment may have changed, or whose context changed. Their
+ * extent is added to ranges. */
+static GPtrArray *
+changed_units(processor_t *ctx,
+              struct tier_run *run,
+              parser_t *base,
+              parser_t *parser,
+              const TSInputEdit *edit,
+              GArray *ranges,
+              guint32 *bytes)
+{
+  const struct node_entry *entries;
+  GPtrArray *units;
+  gboolean *dirty;
+  guint32 *tops;
+  guint n_ranges = ranges->len;
+  guint count;
+  guint n = 0;
+
+  units = g_ptr_array_new_with_free_func((GDestroyNotify) parser_unref);
+  *bytes = 0;
+  if (parser->nodes == NULL) {
+    return units;
+  }
+
+  entries = (const struct node_entry *) parser->nodes->entries->data;
+  count = parser_unit_end(parser);
+  tops = g_new(guint32, count);
+  dirty = g_new0(gboolean, count);
+  for (guint32 child = 1; n < count && child < entries[0].end;
+       child = entries[child].end) {
+    tops[n++] = child;
+  }
+
+  for (guint r = 0; r < n_ranges; r++) {
+    TSRange *range = &g_array_index(ranges, TSRange, r);
+
+    for (guint i = 0; i < n; i++) {
+      const struct node_entry *e = &entries[tops[i]];
+
+      if (e->start_byte <= range->end_byte &&
+          e->end_byte >= range->start_byte) {
+        dirty[i] = TRUE;
+      } else if (e->start_byte > range->end_byte) {
+        dirty[i] = TRUE;
+        break;
+      }
+    }
+  }
+
+  for (guint i = 0; i < n; i++) {
+    const struct node_entry *e = &entries[tops[i]];
+    guint32 old_start = e->start_byte;
+
+    if (dirty[i]) {
+      continue;
+    }
+    /* Clean nodes are before or after the edit */
+    if (e->start_byte >= edit->new_end_byte) {
+      old_start = e->start_byte - edit->new_end_byte + edit->old_end_byte;
+    }
+    dirty[i] = context_changed(ctx, run, base, parser, old_start,
+                               e->start_byte, e->end_byte - e->start_byte);
+  }
+
+  for (guint i = 0; i < n; i++) {
+    TSRange extent;
+    guint start = i;
+
+    if (!dirty[i]) {
+      continue;
+    }
+    while (i + 1 < n && dirty[i + 1]) {
+      i++;
+    }
+    g_ptr_array_add(units, parser_unit_new(parser, start, i + 1));
+
+    extent.start_byte = entries[tops[start]].start_byte;
+    extent.end_byte = entries[tops[i]].end_byte;
+    extent.start_point = ts_node_start_point(
+      node_table_node(parser->nodes, tops[start]));
+    extent.end_point = ts_node_end_point(
+      node_table_node(parser->nodes, tops[i]));
+    g_array_append_val(ranges, extent);
+    *bytes += extent.end_byte - extent.start_byte;
+  }
+
+  g_free(tops);
+  g_free(dirty);
+  return units;
+}
+
+/* Whether a rule of the tier is disabled, its problems would be missing
+ * from the base or kept from it */
+static gboolean
+any_disabled(processor_t *ctx, struct tier_run *run)
+{
+  for (guint i = 0; i < ctx->processors->len; i++) {
+    struct proc_ctx *current = g_ptr_array_index(ctx->processors, i);
+
+    if (current->tier == run->tier && run->disabled[i]) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Adds the problems of base outside what changed since, then runs the
+ * rules over the top level nodes that changed. FALSE when too much changed
+ * to be worth it, res is left alone then. */
+static gboolean
+run_processors_changed(processor_t *ctx,
+                       parser_t *parser,
+                       parser_t *base,
+                       problems_t *base_problems,
+                       struct tier_run *run,
+                       problems_t *res)
+{
+  GPtrArray *units;
+  GArray *ranges;
+  TSInputEdit edit;
+  guint32 bytes;
+  gboolean done = FALSE;
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(base);
+  g_assert(run);
+  g_assert(res);
+
+  if (parser->tree == NULL || base->tree == NULL) {
+    return FALSE;
+  }
+
+  ranges = parser_changed_ranges(base, parser, &edit);
+  units = changed_units(ctx, run, base, parser, &edit, ranges, &bytes);
+  if (bytes * CHANGED_MAX_SHARE > content_size(parser)) {
+    goto out;
+  }
+
+  keep_unchanged(base_problems, &edit, ranges);
+  problems_append(res, base_problems);
+  for (guint i = 0; i < units->len; i++) {
+    run_processors(ctx, g_ptr_array_index(units, i), run, res);
+  }
+  done = TRUE;
+
+  g_message("Analyzed %u bytes in %u units of %s, %zu bytes unchanged",
+            bytes, units->len, parser->file, content_size(parser) - bytes);
+
+  /* Fall through */
+out:
+  g_ptr_array_unref(units);
+  g_array_unref(ranges);
+  return done;
+}
+
+static guint
+job_tiers(parser_t *parser)
+{
+  g_assert(parser);
+
+  switch (parser->message->type) {
+  case MESSAGE_TYPE_CHANGE:
+    return 1u << PROCESS_TIER_CHEAP;
+  case MESSAGE_TYPE_SAVE:
+    return 1u << PROCESS_TIER_EXPENSIVE;
+  default:
+    return ALL_TIERS;
+  }
+}
+
+static struct budget *
+get_budget(processor_t *ctx, struct document *doc, guint rule)
+{
+  g_assert(ctx);
+  g_assert(doc);
+
+  if (doc->budgets == NULL) {
+    doc->budgets = g_array_new(FALSE, TRUE, sizeof(struct budget));
+  }
+  if (doc->budgets->len < ctx->processors->len) {
+    g_array_set_size(doc->budgets, ctx->processors->len);
+  }
+  return &g_array_index(doc->budgets, struct budget, rule);
+}
+
+/* Looks up the rules disabled for the document, giving them another chance
+ * once enough of it was edited since */
+static void
+prepare_run(processor_t *ctx, parser_t *parser, struct tier_run *run)
+{
+  struct document *doc;
+  parser_t *seen = NULL;
+  gboolean any = FALSE;
+  gsize edited = 0;
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(run);
+
+  if (parser->file == NULL || parser->content == NULL) {
+    return;
+  }
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  if (doc != NULL && doc->seen != NULL &&
+      doc->seen->version < parser->version) {
+    seen = parser_ref(doc->seen);
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  /* Outside of the lock, it goes over the whole content */
+  if (seen != NULL) {
+    edited = parser_edit_size(seen, parser);
+  }
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  if (doc != NULL && doc->seen != seen) {
+    /* Another analysis already counted it */
+    edited = 0;
+  }
+  for (guint i = 0; doc != NULL && i < ctx->processors->len; i++) {
+    struct proc_ctx *current = g_ptr_array_index(ctx->processors, i);
+    struct budget *b = get_budget(ctx, doc, i);
+
+    if (b->disabled) {
+      b->edited += edited;
+      if (b->edited * BUDGET_REARM_SHARE >= b->disabled_size) {
+        g_message("Re-enabling rule %s for %s, %zu bytes edited",
+                  current->name, parser->file, b->edited);
+        b->disabled = FALSE;
+        b->overruns = 0;
+      }
+    }
+    run->disabled[i] = b->disabled;
+    any |= b->disabled;
+  }
+  if (doc != NULL) {
+    /* Edits only need measuring while a rule is disabled */
+    if (!any) {
+      g_clear_pointer(&doc->seen, parser_unref);
+    } else if (doc->seen == NULL || doc->seen == seen) {
+      parser_unref(doc->seen);
+      doc->seen = parser_ref(parser);
+    }
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  parser_unref(seen);
+}
+
+/* Counts budget overruns, the client is told about the rules of the tier
+ * disabled for the document */
+static void
+check_budgets(processor_t *ctx, parser_t *parser, struct tier_run *run)
+{
+  struct document *doc;
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(run);
+
+  if (parser->file == NULL) {
+    return;
+  }
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  for (guint i = 0; doc != NULL && i < ctx->processors->len; i++) {
+    struct proc_ctx *current = g_ptr_array_index(ctx->processors, i);
+    struct budget *b;
+    gint64 budget;
+
+    if (current->tier != run->tier) {
+      continue;
+    }
+    b = get_budget(ctx, doc, i);
+    budget = run->tier == PROCESS_TIER_CHEAP ? CHEAP_BUDGET : EXPENSIVE_BUDGET;
+
+    if (!run->disabled[i] && !parser_is_cancelled(parser)) {
+      b->overruns = run->times[i] > budget ? b->overruns + 1 : 0;
+      if (b->overruns >= BUDGET_STRIKES) {
+        gchar *text;
+
+        g_warning("Disabling rule %s for %s, it took %ld us (budget %ld us)",
+                  current->name, parser->file, run->times[i], budget);
+        b->disabled = TRUE;
+        b->disabled_size = content_size(parser);
+        b->edited = 0;
+        if (doc->seen == NULL) {
+          doc->seen = parser_ref(parser);
+        }
+        /* Not a diagnostic, those are stored, merged and shifted */
+        text = g_strdup_printf("Rule %s is disabled for %s until more of it "
+                               "is edited, it took more than %ld ms %d times "
+                               "in a row",
+                               current->name, parser->file,
+                               budget / G_TIME_SPAN_MILLISECOND,
+                               BUDGET_STRIKES);
+        run->responses = g_list_append(run->responses,
+                                       message_show(MESSAGE_SHOW_INFO, text));
+        g_free(text);
+      }
+    }
+  }
+  g_mutex_unlock(&ctx->file_lock);
+}
+
+/* The problems of tier, the answers of the processes are added to
+ * responses */
+static problems_t *
+analyze_tier(processor_t *ctx,
+             parser_t *parser,
+             enum process_tier tier,
+             GList **responses)
+{
+  problems_t *dia = NULL;
+  problems_t *base_problems = NULL;
+  parser_t *base;
+  gint64 cpu_start;
+  struct tier_run run;
+  enum result_store_state stored = RESULT_STORE_BYPASS;
+  gboolean incremental = FALSE;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  if (parser->file != NULL && parser->content != NULL) {
+    stored = result_store_claim(ctx->results, parser->file, tier,
+                                parser->version, parser->cancellable, &dia);
+  }
+
+  if (stored == RESULT_STORE_HIT) {
+    g_message("Tier %u results for %s version %ld taken from the store", tier,
+              parser->file, parser->version);
+    return dia;
+  }
+
+  dia = problems_new();
+  run.tier = tier;
+  run.disabled = g_new0(gboolean, ctx->processors->len);
+  run.times = g_new0(gint64, ctx->processors->len);
+  run.responses = NULL;
+  prepare_run(ctx, parser, &run);
+
+  base = get_base(ctx, parser, tier, &base_problems);
+
+  cpu_start = thread_cpu_time();
+  parser_parse_from(parser, base);
+  if (base != NULL && !any_disabled(ctx, &run)) {
+    incremental = run_processors_changed(ctx, parser, base, base_problems,
+                                         &run, dia);
+  }
+  if (!incremental) {
+    run_processors_parallel(ctx, parser, &run, dia);
+  }
+  account_analysis(ctx, parser, thread_cpu_time() - cpu_start,
+                   incremental);
+  problems_free(base_problems);
+  parser_unref(base);
+
+  if (parser->file != NULL && parser->tree != NULL &&
+      !parser_is_cancelled(parser)) {
+    if (any_disabled(ctx, &run)) {
+      set_base(ctx, parser->file, NULL, tier, NULL);
+    } else {
+      set_base(ctx, parser->file, parser, tier, problems_copy(dia));
+    }
+  }
+
+  check_budgets(ctx, parser, &run);
+  g_free(run.disabled);
+  g_free(run.times);
+  *responses = g_list_concat(*responses, run.responses);
+
+  if (stored == RESULT_STORE_COMPUTE) {
+    if (parser_is_cancelled(parser)) {
+      result_store_abandon(ctx->results, parser->file, tier, parser->version);
+    } else {
+      result_store_complete(ctx->results, parser->file, tier, parser->version,
+                            dia);
+    }
+  }
+  return dia;
+}
+
+/* Remembers the tiers that ran and fills in the newest results of the
+ * others, consumes results */
+static problems_t *
+merge_tiers(processor_t *ctx,
+            parser_t *parser,
+            guint tiers,
+            problems_t **results)
+{
+  struct document *doc;
+  problems_t *merged = problems_new();
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(results);
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  for (guint t = 0; t < PROCESS_TIER_COUNT; t++) {
+    if ((tiers & (1u << t)) == 0) {
+      if (doc != NULL) {
+        problems_append(merged, doc->tier_results[t]);
+      }
+      continue;
+    }
+    /* Cancelled under the lock by a newer version or a reopen, which may
+     * have a lower version */
+    if (doc != NULL && !parser_is_cancelled(parser) &&
+        parser->version >= doc->tier_version[t]) {
+      problems_free(doc->tier_results[t]);
+      doc->tier_results[t] = problems_copy(results[t]);
+      doc->tier_version[t] = parser->version;
+    }
+    problems_append(merged, results[t]);
+    g_clear_pointer(&results[t], problems_free);
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  problems_sort(merged);
+  return merged;
+}
+
+/* Whether the client was last sent exactly the problems of hash. Called with
+ * file_lock held. */
+static gboolean
+is_published(processor_t *ctx, parser_t *parser, guint64 hash)
+{
+  struct document *doc;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  /* An opened file starts without diagnostics on the client */
+  if (parser->message->type == MESSAGE_TYPE_OPEN) {
+    return FALSE;
+  }
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  return doc != NULL && doc->published && doc->published_hash == hash;
+}
+
+/* Publishes the diagnostics of the file unless they are those the client
+ * already has */
+static void
+publish_diagnostics(processor_t *ctx, parser_t *parser, const problems_t *dia)
+{
+  struct document *doc;
+  guint64 hash;
+  gchar *msg = NULL;
+  gboolean skip;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  hash = problems_hash(dia);
+  g_mutex_lock(&ctx->file_lock);
+  skip = is_published(ctx, parser, hash);
+  g_mutex_unlock(&ctx->file_lock);
+
+  if (!skip) {
+    msg = message_diagnostic(0, parser->file, dia);
+  }
+
+  g_mutex_lock(&ctx->file_lock);
+  /* Another worker may have published the same meanwhile. The message is
+   * queued under the lock so the hash follows the order of the messages. */
+  skip = skip || is_published(ctx, parser, hash);
+  if (skip) {
+    ctx->stats.publishes_suppressed++;
+  } else {
+    doc = g_hash_table_lookup(ctx->documents, parser->file);
+    if (doc != NULL) {
+      doc->published = TRUE;
+      doc->published_hash = hash;
+    }
+    ctx->stats.publishes++;
+    g_async_queue_push(ctx->messages, msg);
+    msg = NULL;
+  }
+  g_message("%s notification diagnostics: %u, %lu of %lu unchanged and "
+            "not sent",
+            skip ? "Skipping" : "Sending", problems_len(dia),
+            ctx->stats.publishes_suppressed,
+            ctx->stats.publishes + ctx->stats.publishes_suppressed);
+  g_mutex_unlock(&ctx->file_lock);
+
+  g_free(msg);
+}
+
 static void
 thread_func(gpointer data, gpointer user_data)
 {
   processor_t *ctx = (processor_t *) user_data;
-  parser_t *parser = (parser_t *) data;
-  GList *dia = NULL;
+  struct job *job = (struct job *) data;
+  parser_t *parser = job->parser;
+  problems_t *results[PROCESS_TIER_COUNT] = { NULL };
+  problems_t *dia = NULL;
+  GList *responses = NULL;
   gchar *msg;
+  guint tiers;
 
   g_assert(data);
   g_assert(user_data);
 
-  for (guint i = 0; i < ctx->processors->len; i++) {
-    struct proc_ctx *current;
-    GList *resp;
+  g_atomic_int_inc(&ctx->busy);
 
-    current = g_ptr_array_index(ctx->processors, i);
-    resp = current->func(parser, current->user_data);
-    dia = g_list_concat(dia, resp);
+  tiers = job_tiers(parser);
+  for (guint t = 0; t < PROCESS_TIER_COUNT && !parser_is_cancelled(parser);
+       t++) {
+    if ((tiers & (1u << t)) != 0) {
+      results[t] = analyze_tier(ctx, parser, t, &responses);
+    }
+  }
+
+  if (parser_is_cancelled(parser)) {
+    if (parser->message->type == MESSAGE_TYPE_DIAGNOSTIC) {
+      msg = message_error_response(parser->message->data.diagnostic.id,
+                                   MESSAGE_REQUEST_CANCELLED,
+                                   "Request cancelled");
+      answer_request(ctx, job, msg);
+    }
+    /* Otherwise a newer version is queued and publishes its own diagnostics */
+    for (guint t = 0; t < PROCESS_TIER_COUNT; t++) {
+      problems_free(results[t]);
+    }
+    g_list_free_full(responses, g_free);
+    goto out;
   }
   g_message("Handled message of type %d", parser->message->type);
 
+  if (parser->message->type == MESSAGE_TYPE_OPEN ||
+      parser->message->type == MESSAGE_TYPE_CHANGE ||
+      parser->message->type == MESSAGE_TYPE_SAVE) {
+    dia = merge_tiers(ctx, parser, tiers, results);
+  } else {
+    dia = problems_new();
+    for (guint t = 0; t < PROCESS_TIER_COUNT; t++) {
+      problems_append(dia, results[t]);
+      problems_free(results[t]);
+    }
+  }
+
   if (parser->message->type == MESSAGE_TYPE_DIAGNOSTIC) {
-    g_message("Sending diagnostics: %d", g_list_length(dia));
+    problems_sort(dia);
+    g_message("Sending diagnostics: %u", problems_len(dia));
     msg = message_diagnostic(parser->message->data.diagnostic.id, parser->file,
                              dia);
-    g_async_queue_push(ctx->messages, msg);
-    g_list_free_full(dia, message_problem_free);
+    answer_request(ctx, job, msg);
   }
   if (parser->message->type == MESSAGE_TYPE_OPEN ||
-      parser->message->type == MESSAGE_TYPE_CHANGE) {
-    g_message("Sending notification diagnostics: %d", g_list_length(dia));
-    msg = message_diagnostic(0, parser->file, dia);
-    g_async_queue_push(ctx->messages, msg);
-    g_list_free_full(dia, message_problem_free);
+      parser->message->type == MESSAGE_TYPE_CHANGE ||
+      parser->message->type == MESSAGE_TYPE_SAVE) {
+    publish_diagnostics(ctx, parser, dia);
   }
+  problems_free(dia);
 
-  if (parser->message->type == MESSAGE_TYPE_INITIALIZE) {
-    g_async_queue_push(ctx->messages, g_strdup(dia->data));
-    g_list_free_full(dia, g_free);
+  /* The answer to initialize comes from its process */
+  for (GList *l = responses; l != NULL; l = l->next) {
+    g_async_queue_push(ctx->messages, l->data);
   }
+  g_list_free(responses);
 
+  /* Fall through */
+out:
   parser_unref(parser);
+  g_free(job);
+
+  g_atomic_int_add(&ctx->busy, -1);
+  adapt_pool(ctx);
+}
+
+static gint
+job_compare(gconstpointer a, gconstpointer b, G_GNUC_UNUSED gpointer user_data)
+{
+  const struct job *ja = (const struct job *) a;
+  const struct job *jb = (const struct job *) b;
+
+  if (ja->priority != jb->priority) {
+    return ja->priority < jb->priority ? -1 : 1;
+  }
+  if (ja->seq != jb->seq) {
+    return ja->seq < jb->seq ? -1 : 1;
+  }
+  return 0;
+}
+
+static gboolean
+push_job(processor_t *ctx,
+         parser_t *parser,
+         enum job_priority priority,
+         GError **err)
+{
+  struct job *job;
+
+  g_assert(ctx);
+  g_assert(parser);
+  g_assert(err == NULL || *err == NULL);
+
+  job = g_malloc0(sizeof(*job));
+  job->parser = parser;
+  job->priority = priority;
+  job->seq = g_atomic_int_add(&ctx->job_seq, 1);
+  job->queued = g_get_monotonic_time();
+
+  if (!g_thread_pool_push(ctx->pool, job, err)) {
+    g_free(job);
+    return FALSE;
+  }
+  adapt_pool(ctx);
+  return TRUE;
 }
 
 static gpointer
@@ -90,6 +1347,273 @@ message_writer(gpointer data)
   return NULL;
 }
 
+/* Drops what is known of an earlier session of the document, a reopened
+ * file may restart at a lower version. Called with file_lock held. */
+static void
+forget_session(struct document *doc)
+{
+  g_assert(doc);
+
+  for (guint t = 0; t < PROCESS_TIER_COUNT; t++) {
+    g_clear_pointer(&doc->tier_results[t], problems_free);
+    doc->tier_version[t] = 0;
+    g_clear_pointer(&doc->base[t], parser_unref);
+    g_clear_pointer(&doc->base_problems[t], problems_free);
+  }
+  doc->published = FALSE;
+  doc->published_hash = 0;
+  /* Edits of disabled rules are measured from the next version again */
+  g_clear_pointer(&doc->seen, parser_unref);
+}
+
+static void
+new_analysis(processor_t *ctx, parser_t *parser)
+{
+  struct document *doc;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  if (doc == NULL) {
+    doc = g_malloc0(sizeof(*doc));
+    g_hash_table_insert(ctx->documents, g_strdup(parser->file), doc);
+  }
+  if (doc->analysis != NULL) {
+    /* Whatever is running for the previous version is now obsolete */
+    g_cancellable_cancel(doc->analysis);
+    g_object_unref(doc->analysis);
+  }
+  if (parser->message->type == MESSAGE_TYPE_OPEN) {
+    forget_session(doc);
+  }
+  doc->analysis = g_cancellable_new();
+  doc->version = parser->version;
+  parser->cancellable = g_object_ref(doc->analysis);
+  if (parser->message->type == MESSAGE_TYPE_CHANGE) {
+    doc->idle_deadline = g_get_monotonic_time() + IDLE_DELAY;
+    g_cond_signal(&ctx->file_cond);
+  } else {
+    /* didOpen runs all tiers */
+    doc->idle_deadline = 0;
+  }
+  g_mutex_unlock(&ctx->file_lock);
+}
+
+/* Saves analyze the newest version, and are obsolete with it */
+static void
+join_analysis(processor_t *ctx, parser_t *parser)
+{
+  struct document *doc;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  g_mutex_lock(&ctx->file_lock);
+  doc = g_hash_table_lookup(ctx->documents, parser->file);
+  if (doc != NULL) {
+    parser->version = doc->version;
+    if (doc->analysis != NULL) {
+      parser->cancellable = g_object_ref(doc->analysis);
+    }
+    doc->idle_deadline = 0;
+  }
+  g_mutex_unlock(&ctx->file_lock);
+}
+
+static void
+new_request(processor_t *ctx, parser_t *parser)
+{
+  gint64 id;
+  struct document *doc;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  id = parser->message->data.diagnostic.id;
+  parser->cancellable = g_cancellable_new();
+
+  g_mutex_lock(&ctx->file_lock);
+  if (parser->file != NULL) {
+    /* The request is answered for the newest known content */
+    doc = g_hash_table_lookup(ctx->documents, parser->file);
+    if (doc != NULL) {
+      parser->version = doc->version;
+    }
+  }
+  g_hash_table_replace(ctx->requests, g_memdup2(&id, sizeof(id)),
+                       g_object_ref(parser->cancellable));
+  g_mutex_unlock(&ctx->file_lock);
+}
+
+/* Takes back what new_analysis() and new_request() registered for a parser
+ * that could not be queued */
+static void
+drop_analysis(processor_t *ctx, parser_t *parser)
+{
+  struct document *doc;
+  gint64 id;
+
+  g_assert(ctx);
+  g_assert(parser);
+
+  g_mutex_lock(&ctx->file_lock);
+  if (parser->message->type == MESSAGE_TYPE_DIAGNOSTIC) {
+    id = parser->message->data.diagnostic.id;
+    if (g_hash_table_lookup(ctx->requests, &id) == parser->cancellable) {
+      g_hash_table_remove(ctx->requests, &id);
+    }
+  }
+  if (parser->message->type == MESSAGE_TYPE_OPEN ||
+      parser->message->type == MESSAGE_TYPE_CHANGE) {
+    doc = g_hash_table_lookup(ctx->documents, parser->file);
+    if (doc != NULL && doc->analysis == parser->cancellable) {
+      g_clear_object(&doc->analysis);
+    }
+  }
+  g_mutex_unlock(&ctx->file_lock);
+}
+
+static void
+cancel_request(processor_t *ctx, gint64 id)
+{
+  GCancellable *cancellable;
+
+  g_assert(ctx);
+
+  g_mutex_lock(&ctx->file_lock);
+  cancellable = g_hash_table_lookup(ctx->requests, &id);
+  if (cancellable != NULL) {
+    /* The worker answers with RequestCancelled */
+    g_cancellable_cancel(cancellable);
+  }
+  g_mutex_unlock(&ctx->file_lock);
+
+  g_message("Cancel request %ld: %s", id,
+            cancellable != NULL ? "cancelled" : "not pending");
+}
+
+static gboolean
+queue_message(processor_t *ctx,
+              message_t *msg,
+              enum job_priority priority,
+              GError **err)
+{
+  struct parser_ctx *parser;
+
+  g_assert(ctx);
+  g_assert(msg);
+  g_assert(err == NULL || *err == NULL);
+
+  /* Parsing is left to the worker, the result may already be stored */
+  g_mutex_lock(&ctx->file_lock);
+  parser = parser_new_deferred(msg, ctx->files);
+  g_mutex_unlock(&ctx->file_lock);
+  parser->summaries = ctx->summaries;
+
+  if (msg->type == MESSAGE_TYPE_OPEN) {
+    result_store_forget(ctx->results, parser->file);
+  }
+  if (msg->type == MESSAGE_TYPE_OPEN || msg->type == MESSAGE_TYPE_CHANGE) {
+    new_analysis(ctx, parser);
+  }
+  if (msg->type == MESSAGE_TYPE_OPEN) {
+    /* Once the analyses of the earlier session are cancelled, their
+     * versions may be higher than the new ones */
+    summary_store_forget(ctx->summaries, parser->file);
+  }
+  if (msg->type == MESSAGE_TYPE_SAVE) {
+    join_analysis(ctx, parser);
+  }
+  if (msg->type == MESSAGE_TYPE_DIAGNOSTIC) {
+    new_request(ctx, parser);
+  }
+
+  if (!push_job(ctx, parser, priority, err)) {
+    drop_analysis(ctx, parser);
+    /* Frees msg */
+    parser_unref(parser);
+    return FALSE;
+  }
+  /* Every parsing instance holds their own reference */
+  return TRUE;
+}
+
+static void
+queue_idle_analysis(processor_t *ctx, const gchar *uri)
+{
+  message_t *msg;
+  GError *lerr = NULL;
+
+  g_assert(ctx);
+  g_assert(uri);
+
+  /* Same as a save, without the client asking for it */
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_SAVE;
+  msg->data.save.uri = g_strdup(uri);
+
+  g_message("%s is idle, queuing expensive rules", uri);
+  if (!queue_message(ctx, msg, JOB_PRIORITY_BACKGROUND, &lerr)) {
+    g_warning("Could not queue idle analysis of %s: %s", uri,
+              lerr ? lerr->message : "No error message");
+    g_clear_error(&lerr);
+  }
+}
+
+static gpointer
+idle_scheduler(gpointer data)
+{
+  processor_t *ctx = (processor_t *) data;
+  GPtrArray *due;
+
+  g_assert(data);
+
+  due = g_ptr_array_new_with_free_func(g_free);
+
+  g_mutex_lock(&ctx->file_lock);
+  while (TRUE) {
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    gint64 now = g_get_monotonic_time();
+    gint64 next = G_MAXINT64;
+
+    g_hash_table_iter_init(&iter, ctx->documents);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      struct document *doc = (struct document *) value;
+
+      if (doc->idle_deadline == 0) {
+        continue;
+      }
+      if (doc->idle_deadline <= now) {
+        doc->idle_deadline = 0;
+        g_ptr_array_add(due, g_strdup(key));
+      } else {
+        next = MIN(next, doc->idle_deadline);
+      }
+    }
+
+    if (due->len > 0) {
+      g_mutex_unlock(&ctx->file_lock);
+      for (guint i = 0; i < due->len; i++) {
+        queue_idle_analysis(ctx, g_ptr_array_index(due, i));
+      }
+      g_ptr_array_set_size(due, 0);
+      g_mutex_lock(&ctx->file_lock);
+    } else if (next == G_MAXINT64) {
+      g_cond_wait(&ctx->file_cond, &ctx->file_lock);
+    } else {
+      g_cond_wait_until(&ctx->file_cond, &ctx->file_lock, next);
+    }
+  }
+  g_mutex_unlock(&ctx->file_lock);
+  g_ptr_array_unref(due);
+
+  return NULL;
+}
+
 processor_t *
 processor_new(GOutputStream *out)
 {
@@ -101,40 +1625,127 @@ processor_new(GOutputStream *out)
 
   ctx->out = g_object_ref(out);
   ctx->messages = g_async_queue_new();
-  ctx->pool = g_thread_pool_new(thread_func, ctx, MAX_THREADS, FALSE, NULL);
+  ctx->min_workers = 1;
+  ctx->max_workers = cpus_available();
+  ctx->workers = ctx->max_workers;
+  g_mutex_init(&ctx->pool_lock);
+  ctx->pool = g_thread_pool_new(thread_func, ctx, ctx->workers, FALSE, NULL);
+  ctx->unit_pool = g_thread_pool_new(unit_worker, NULL, ctx->max_workers,
+                                     FALSE, NULL);
+  g_thread_pool_set_sort_function(ctx->pool, job_compare, NULL);
 
   ctx->writer = g_thread_new("response writer", message_writer, ctx);
   ctx->processors = g_ptr_array_new();
+  ctx->visitor = visitor_new();
   ctx->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  ctx->documents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         document_free);
+  ctx->requests = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                        g_object_unref);
+  ctx->results = result_store_new();
+  ctx->functions = function_cache_new(FUNCTION_CACHE_ENTRIES);
+  visitor_set_cache(ctx->visitor, ctx->functions);
+  ctx->summaries = summary_store_new();
+  g_mutex_init(&ctx->file_lock);
+  g_cond_init(&ctx->file_cond);
+  ctx->idle = g_thread_new("idle scheduler", idle_scheduler, ctx);
   return ctx;
 }
 
 gboolean
 processor_handle_message(processor_t *ctx, message_t *msg, GError **err)
 {
-  struct parser_ctx *parser;
+  enum job_priority priority = JOB_PRIORITY_NOTIFICATION;
 
   g_return_val_if_fail(ctx != NULL, FALSE);
+  g_return_val_if_fail(ctx->compiled, FALSE);
   g_return_val_if_fail(msg != NULL, FALSE);
   g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
-  parser = parser_new(msg, ctx->files);
+  if (msg->type == MESSAGE_TYPE_INITIALIZE) {
+    set_worker_limits(ctx, msg->data.init.min_workers,
+                      msg->data.init.max_workers);
+  }
 
-  if (!g_thread_pool_push(ctx->pool, parser, err)) {
-    return FALSE;
-    parser_unref(parser);
+  if (msg->type == MESSAGE_TYPE_CANCEL) {
+    /* Handled right away, queuing it would put it behind the request */
+    cancel_request(ctx, msg->data.cancel.id);
+    message_free(msg);
+    return TRUE;
   }
-  /* Every parsing instance holds their own reference */
-  return TRUE;
+
+  if (msg->type == MESSAGE_TYPE_INITIALIZE ||
+      msg->type == MESSAGE_TYPE_DIAGNOSTIC) {
+    priority = JOB_PRIORITY_REQUEST;
+  }
+
+  return queue_message(ctx, msg, priority, err);
 }
 
 void
-processor_add_process(processor_t *ctx, process_func_t func, gpointer user_data)
+processor_add_process(processor_t *ctx,
+                      const gchar *name,
+                      process_func_t func,
+                      enum process_tier tier,
+                      gpointer user_data)
 {
   struct proc_ctx *pctx;
 
   pctx = g_malloc0(sizeof(*pctx));
+  pctx->name = name;
   pctx->func = func;
+  pctx->tier = tier;
   pctx->user_data = user_data;
   g_ptr_array_add(ctx->processors, pctx);
 }
+
+void
+processor_add_rule(processor_t *ctx,
+                   const gchar *name,
+                   visitor_register_func_t reg,
+                   enum process_tier tier)
+{
+  struct proc_ctx *pctx;
+
+  g_return_if_fail(ctx != NULL);
+  g_return_if_fail(!ctx->compiled);
+  g_return_if_fail(reg != NULL);
+
+  pctx = g_malloc0(sizeof(*pctx));
+  pctx->name = name;
+  pctx->tier = tier;
+  reg(ctx->visitor, ctx->processors->len);
+  g_ptr_array_add(ctx->processors, pctx);
+}
+
+gboolean
+processor_compile(processor_t *ctx, GError **err)
+{
+  g_return_val_if_fail(ctx != NULL, FALSE);
+  g_return_val_if_fail(!ctx->compiled, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  /* The query is read without locks once workers run */
+  if (!visitor_compile(ctx->visitor)) {
+    g_set_error(err, MESSAGE_ERROR, -1,
+                "The queries of the rules do not compile");
+    return FALSE;
+  }
+  ctx->compiled = TRUE;
+  return TRUE;
+}
+
+void
+processor_get_stats(processor_t *ctx, struct processor_stats *stats)
+{
+  g_return_if_fail(ctx != NULL);
+  g_return_if_fail(stats != NULL);
+
+  g_mutex_lock(&ctx->file_lock);
+  *stats = ctx->stats;
+  g_mutex_unlock(&ctx->file_lock);
+
+  result_store_get_stats(ctx->results, &stats->results);
+  function_cache_get_stats(ctx->functions, &stats->functions);
+  summary_store_get_stats(ctx->summaries, &stats->summaries);
+}
@@ -4,8 +4,12 @@
 #include <glib.h>
 #include "glibconfig.h"
 
+#include "function_cache.h"
 #include "message.h"
 #include "parser.h"
+#include "result_store.h"
+#include "summary_store.h"
+#include "visitor.h"
 
 G_BEGIN_DECLS
 
@@ -16,14 +20,69 @@ struct process_ctx {
   struct init_config conf;
 };
 
+struct processor_stats {
+  /* Analyses that ran to the end */
+  guint64 analyses;
+  /* Of them, analyses that only ran the rules over what changed */
+  guint64 incremental;
+  /* Analyses abandoned because a newer version of the file arrived */
+  guint64 cancelled;
+  /* CPU time (us) spent on cancelled analyses before they gave up */
+  gint64 cancelled_cpu_time;
+  /* Estimated CPU time (us) not spent thanks to cancellation */
+  gint64 saved_cpu_time;
+  /* Requests answered with a result */
+  guint64 requests;
+  /* Requests cancelled by the client */
+  guint64 requests_cancelled;
+  /* Summed and worst queue-to-answer latency (us) of answered requests */
+  gint64 request_latency;
+  gint64 max_request_latency;
+  /* Diagnostics notifications sent, and those not sent because the client
+   * already had the same */
+  guint64 publishes;
+  guint64 publishes_suppressed;
+  /* Result store hits and duplicated work */
+  struct result_store_stats results;
+  /* Reuse of the problems of unchanged top level declarations */
+  struct function_cache_stats functions;
+  /* Lookups of what functions of other files assert */
+  struct summary_store_stats summaries;
+};
+
+enum process_tier {
+  /* Syntactic rules, run on every change */
+  PROCESS_TIER_CHEAP = 0,
+  /* Deep rules, run on open, on save and when the file has been idle */
+  PROCESS_TIER_EXPENSIVE,
+  PROCESS_TIER_COUNT
+};
+
 typedef struct processor processor_t;
 
 typedef GList * (*process_func_t)(parser_t*, struct process_ctx *);
 
 processor_t *processor_new(GOutputStream *out);
 
+/* Takes msg, also when it could not be handled */
 gboolean processor_handle_message(processor_t *ctx, message_t *msg, GError **err);
-void
-processor_add_process(processor_t *ctx, process_func_t func, gpointer user_data);
+void processor_add_process(processor_t *ctx,
+                           const gchar *name,
+                           process_func_t func,
+                           enum process_tier tier,
+                           gpointer user_data);
+
+/* Adds a rule whose callbacks and queries share the single walk and query
+ * pass of every analysis */
+void processor_add_rule(processor_t *ctx,
+                        const gchar *name,
+                        visitor_register_func_t reg,
+                        enum process_tier tier);
+
+/* Compiles the queries of all rules once they are added, before the first
+ * message is handled */
+gboolean processor_compile(processor_t *ctx, GError **err);
+
+void processor_get_stats(processor_t *ctx, struct processor_stats *stats);
 
 G_END_DECLS
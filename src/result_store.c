@@ -0,0 +1,228 @@
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "problems.h"
+#include "result_store.h"
+
+/* How often a waiting request looks at its cancellable */
+#define WAIT_SLICE (50 * G_TIME_SPAN_MILLISECOND)
+
+enum entry_state {
+  ENTRY_EMPTY = 0,
+  ENTRY_RUNNING,
+  ENTRY_DONE,
+};
+
+/* Only the newest version of every (file, slot) is kept */
+struct entry {
+  gint64 version;
+  enum entry_state state;
+  problems_t *problems;
+};
+
+struct result_store {
+  /* GPtrArray of entries by slot, by uri */
+  GHashTable *entries;
+  GMutex lock;
+  GCond done;
+  struct result_store_stats stats;
+};
+
+static void
+entry_free(gpointer data)
+{
+  struct entry *e = (struct entry *) data;
+
+  if (e == NULL) {
+    return;
+  }
+  problems_free(e->problems);
+  g_free(e);
+}
+
+/* Entries are never freed before the store, waiters may hold them */
+static struct entry *
+get_entry(result_store_t *store, const gchar *uri, guint slot)
+{
+  GPtrArray *slots;
+
+  g_assert(store);
+  g_assert(uri);
+
+  slots = g_hash_table_lookup(store->entries, uri);
+  if (slots == NULL) {
+    slots = g_ptr_array_new_with_free_func(entry_free);
+    g_hash_table_insert(store->entries, g_strdup(uri), slots);
+  }
+  while (slots->len <= slot) {
+    g_ptr_array_add(slots, g_malloc0(sizeof(struct entry)));
+  }
+  return g_ptr_array_index(slots, slot);
+}
+
+result_store_t *
+result_store_new(void)
+{
+  result_store_t *store;
+
+  store = g_malloc0(sizeof(*store));
+  store->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) g_ptr_array_unref);
+  g_mutex_init(&store->lock);
+  g_cond_init(&store->done);
+
+  return store;
+}
+
+void
+result_store_free(result_store_t *store)
+{
+  if (store == NULL) {
+    return;
+  }
+  g_hash_table_unref(store->entries);
+  g_mutex_clear(&store->lock);
+  g_cond_clear(&store->done);
+  g_free(store);
+}
+
+enum result_store_state
+result_store_claim(result_store_t *store,
+                   const gchar *uri,
+                   guint slot,
+                   gint64 version,
+                   GCancellable *cancellable,
+                   problems_t **problems)
+{
+  struct entry *e;
+  gboolean waited = FALSE;
+  enum result_store_state res;
+
+  g_return_val_if_fail(store != NULL, RESULT_STORE_BYPASS);
+  g_return_val_if_fail(uri != NULL, RESULT_STORE_BYPASS);
+  g_return_val_if_fail(problems != NULL, RESULT_STORE_BYPASS);
+
+  g_mutex_lock(&store->lock);
+
+  e = get_entry(store, uri, slot);
+
+  /* Single flight: wait for whoever is computing this version */
+  while (e->version == version && e->state == ENTRY_RUNNING) {
+    if (cancellable != NULL && g_cancellable_is_cancelled(cancellable)) {
+      res = RESULT_STORE_BYPASS;
+      goto out;
+    }
+    waited = TRUE;
+    g_cond_wait_until(&store->done, &store->lock,
+                      g_get_monotonic_time() + WAIT_SLICE);
+  }
+
+  if (e->version == version && e->state == ENTRY_DONE) {
+    *problems = problems_copy(e->problems);
+    store->stats.hits++;
+    if (waited) {
+      store->stats.waits++;
+    }
+    res = RESULT_STORE_HIT;
+    goto out;
+  }
+
+  if (version < e->version) {
+    /* A newer version is already tracked */
+    res = RESULT_STORE_BYPASS;
+    goto out;
+  }
+
+  g_clear_pointer(&e->problems, problems_free);
+  e->version = version;
+  e->state = ENTRY_RUNNING;
+  res = RESULT_STORE_COMPUTE;
+
+  /* Fall through */
+out:
+  g_mutex_unlock(&store->lock);
+  return res;
+}
+
+void
+result_store_complete(result_store_t *store,
+                      const gchar *uri,
+                      guint slot,
+                      gint64 version,
+                      const problems_t *problems)
+{
+  struct entry *e;
+
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(uri != NULL);
+
+  g_mutex_lock(&store->lock);
+  e = get_entry(store, uri, slot);
+  if (e->version == version) {
+    if (e->state == ENTRY_DONE) {
+      store->stats.duplicates++;
+      g_warning("Version %ld of %s (%u) was analyzed twice", version, uri,
+                slot);
+    } else {
+      e->problems = problems_copy(problems);
+      e->state = ENTRY_DONE;
+      store->stats.computed++;
+    }
+  }
+  g_cond_broadcast(&store->done);
+  g_mutex_unlock(&store->lock);
+}
+
+void
+result_store_abandon(result_store_t *store,
+                     const gchar *uri,
+                     guint slot,
+                     gint64 version)
+{
+  struct entry *e;
+
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(uri != NULL);
+
+  g_mutex_lock(&store->lock);
+  e = get_entry(store, uri, slot);
+  if (e->version == version && e->state == ENTRY_RUNNING) {
+    /* Any waiter takes over the computation */
+    e->state = ENTRY_EMPTY;
+  }
+  g_cond_broadcast(&store->done);
+  g_mutex_unlock(&store->lock);
+}
+
+void
+result_store_forget(result_store_t *store, const gchar *uri)
+{
+  GPtrArray *slots;
+
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(uri != NULL);
+
+  g_mutex_lock(&store->lock);
+  slots = g_hash_table_lookup(store->entries, uri);
+  for (guint i = 0; slots != NULL && i < slots->len; i++) {
+    struct entry *e = g_ptr_array_index(slots, i);
+
+    /* Versions restart when a file is reopened, nothing stored is valid */
+    g_clear_pointer(&e->problems, problems_free);
+    e->version = -1;
+    e->state = ENTRY_EMPTY;
+  }
+  g_cond_broadcast(&store->done);
+  g_mutex_unlock(&store->lock);
+}
+
+void
+result_store_get_stats(result_store_t *store, struct result_store_stats *stats)
+{
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(stats != NULL);
+
+  g_mutex_lock(&store->lock);
+  *stats = store->stats;
+  g_mutex_unlock(&store->lock);
+}
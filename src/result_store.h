@@ -0,0 +1,61 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+#include "glibconfig.h"
+
+#include "problems.h"
+
+G_BEGIN_DECLS
+
+enum result_store_state {
+  /* The results are already computed and returned */
+  RESULT_STORE_HIT = 0,
+  /* The caller owns the computation and must complete or abandon it */
+  RESULT_STORE_COMPUTE,
+  /* Not tracked (old version or cancelled), compute without storing */
+  RESULT_STORE_BYPASS,
+};
+
+struct result_store_stats {
+  /* Computations claimed and completed */
+  guint64 computed;
+  /* Answers taken from the store */
+  guint64 hits;
+  /* Answers that had to wait for a running computation */
+  guint64 waits;
+  /* Versions that were computed more than once, should stay 0 */
+  guint64 duplicates;
+};
+
+typedef struct result_store result_store_t;
+
+result_store_t *result_store_new(void);
+
+void result_store_free(result_store_t *store);
+
+/* Results are kept per (uri, slot), every slot holds the newest version */
+enum result_store_state result_store_claim(result_store_t *store,
+                                           const gchar *uri,
+                                           guint slot,
+                                           gint64 version,
+                                           GCancellable *cancellable,
+                                           problems_t **problems);
+
+void result_store_complete(result_store_t *store,
+                           const gchar *uri,
+                           guint slot,
+                           gint64 version,
+                           const problems_t *problems);
+
+void result_store_abandon(result_store_t *store,
+                          const gchar *uri,
+                          guint slot,
+                          gint64 version);
+
+void result_store_forget(result_store_t *store, const gchar *uri);
+
+void result_store_get_stats(result_store_t *store,
+                            struct result_store_stats *stats);
+
+G_END_DECLS
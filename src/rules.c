@@ -0,0 +1,96 @@
+#include <glib.h>
+
+#include "rules.h"
+
+static const struct rule_info rules[RULE_COUNT] = {
+  [RULE_ASSERT_GERROR] = {
+    "asserts.gerror", 3,
+    "GErrors should be asserted (err == NULL || *err == NULL)", 0,
+  },
+  [RULE_ASSERT_PARAM] = {
+    "asserts.param", 3,
+    "Parameter %s should be asserted", 1,
+  },
+  [RULE_COMMENT_NO_RETURN_VALUE] = {
+    "comments.no-return-value", 3,
+    "Function should have a return value", 0,
+  },
+  [RULE_COMMENT_VOID_RETURN] = {
+    "comments.void-return", 3,
+    "Void functions should not document @return", 0,
+  },
+  [RULE_COMMENT_RETURN] = {
+    "comments.return", 3,
+    "Functions return value should be documented with @return", 0,
+  },
+  [RULE_COMMENT_PARAM] = {
+    "comments.param", 3,
+    "Parameter %s is not documented", 1,
+  },
+  [RULE_COMMENT_EXTRA_PARAMS] = {
+    "comments.extra-params", 3,
+    "Extra params are documented", 0,
+  },
+  [RULE_COMMENT_FUNCTION] = {
+    "comments.function", 3,
+    "Function should be documented", 0,
+  },
+  [RULE_COMMENT_BRIEF] = {
+    "comments.brief", 3,
+    "Comment should contain a @brief", 0,
+  },
+  [RULE_COMMENT_FIELD] = {
+    "comments.field", 3,
+    "Struct field should be commented", 0,
+  },
+  [RULE_MIDSCOPE_DECLARATION] = {
+    "midscope.declaration", 3,
+    "Declares should be done at the start of a body", 0,
+  },
+};
+
+/* struct rule_info of the rules added at runtime, by id - RULE_COUNT. Never
+ * freed, ids stay valid for the whole run. */
+static GArray *added = NULL;
+
+const struct rule_info *
+rules_get(enum rule_id id)
+{
+  g_assert(id < rules_count());
+
+  if (id < RULE_COUNT) {
+    return &rules[id];
+  }
+  return &g_array_index(added, struct rule_info, id - RULE_COUNT);
+}
+
+guint
+rules_count(void)
+{
+  return RULE_COUNT + (added != NULL ? added->len : 0);
+}
+
+enum rule_id
+rules_add(const gchar *code,
+          gint severity,
+          const gchar *message,
+          guint n_args)
+{
+  struct rule_info info;
+
+  g_assert(code);
+  g_assert(message);
+  /* Problems keep the id in 16 bits */
+  g_assert(rules_count() < G_MAXUINT16);
+
+  if (added == NULL) {
+    added = g_array_new(FALSE, FALSE, sizeof(struct rule_info));
+  }
+  info.code = g_strdup(code);
+  info.severity = severity;
+  info.message = g_strdup(message);
+  info.n_args = n_args;
+  g_array_append_val(added, info);
+
+  return RULE_COUNT + added->len - 1;
+}
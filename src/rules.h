@@ -0,0 +1,48 @@
+#pragma once
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Every kind of problem the server reports. The ids are sent nowhere, the
+ * codes are and must not change. */
+#define RULES_SOURCE "glib_lsp"
+
+enum rule_id {
+  RULE_ASSERT_GERROR = 0,
+  RULE_ASSERT_PARAM,
+  RULE_COMMENT_NO_RETURN_VALUE,
+  RULE_COMMENT_VOID_RETURN,
+  RULE_COMMENT_RETURN,
+  RULE_COMMENT_PARAM,
+  RULE_COMMENT_EXTRA_PARAMS,
+  RULE_COMMENT_FUNCTION,
+  RULE_COMMENT_BRIEF,
+  RULE_COMMENT_FIELD,
+  RULE_MIDSCOPE_DECLARATION,
+  RULE_COUNT,
+};
+
+struct rule_info {
+  /* Stable diagnostic code */
+  const gchar *code;
+  /* LSP DiagnosticSeverity */
+  gint severity;
+  /* Message, every %s is replaced by the next argument */
+  const gchar *message;
+  guint n_args;
+};
+
+const struct rule_info *rules_get(enum rule_id id);
+
+/* Number of kinds of problems, the ids go from 0 to it */
+guint rules_count(void);
+
+/* Adds a kind of problem defined at runtime, its id is past RULE_COUNT. The
+ * strings are copied. Only call at startup, before rules_get runs on other
+ * threads. */
+enum rule_id rules_add(const gchar *code,
+                       gint severity,
+                       const gchar *message,
+                       guint n_args);
+
+G_END_DECLS
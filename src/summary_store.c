@@ -0,0 +1,250 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <string.h>
+
+#include "summary_store.h"
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME  1099511628211ull
+
+/* What one file defines */
+struct file_summary {
+  gint64 version;
+  /* Fingerprint of the functions, tells a file whose summaries did not
+   * change */
+  guint64 hash;
+  /* guint64 asserted by function name */
+  GHashTable *functions;
+};
+
+struct summary_store {
+  /* struct file_summary by file */
+  GHashTable *files;
+  /* GPtrArray of the struct file_summary defining it, by function name */
+  GHashTable *names;
+  GMutex lock;
+  struct summary_store_stats stats;
+};
+
+static void
+file_summary_free(gpointer data)
+{
+  struct file_summary *fs = (struct file_summary *) data;
+
+  if (fs == NULL) {
+    return;
+  }
+  g_hash_table_unref(fs->functions);
+  g_free(fs);
+}
+
+summary_store_t *
+summary_store_new(void)
+{
+  summary_store_t *store;
+
+  store = g_new0(summary_store_t, 1);
+  store->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                       file_summary_free);
+  store->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify) g_ptr_array_unref);
+  g_mutex_init(&store->lock);
+
+  return store;
+}
+
+void
+summary_store_free(summary_store_t *store)
+{
+  if (store == NULL) {
+    return;
+  }
+  /* The names point into the files */
+  g_hash_table_unref(store->names);
+  g_hash_table_unref(store->files);
+  g_mutex_clear(&store->lock);
+  g_free(store);
+}
+
+gboolean
+summary_store_lookup(summary_store_t *store,
+                     const gchar *name,
+                     guint64 *asserted)
+{
+  GPtrArray *defining;
+
+  g_return_val_if_fail(store != NULL, FALSE);
+  g_return_val_if_fail(name != NULL, FALSE);
+  g_return_val_if_fail(asserted != NULL, FALSE);
+
+  g_mutex_lock(&store->lock);
+  store->stats.lookups++;
+  defining = g_hash_table_lookup(store->names, name);
+  if (defining != NULL) {
+    store->stats.hits++;
+    /* Which definition gets linked is not known, only trust all of them */
+    *asserted = G_MAXUINT64;
+    for (guint i = 0; i < defining->len; i++) {
+      struct file_summary *fs = g_ptr_array_index(defining, i);
+
+      *asserted &= *(guint64 *) g_hash_table_lookup(fs->functions, name);
+    }
+  }
+  g_mutex_unlock(&store->lock);
+
+  return defining != NULL;
+}
+
+/* Removes the names of fs from the index. Called with the lock held. */
+static void
+unindex(summary_store_t *store, struct file_summary *fs)
+{
+  GHashTableIter iter;
+  gpointer name;
+
+  g_hash_table_iter_init(&iter, fs->functions);
+  while (g_hash_table_iter_next(&iter, &name, NULL)) {
+    GPtrArray *defining = g_hash_table_lookup(store->names, name);
+
+    g_ptr_array_remove_fast(defining, fs);
+    if (defining->len == 0) {
+      g_hash_table_remove(store->names, name);
+    }
+  }
+}
+
+/* Adds the names of fs to the index. Called with the lock held. */
+static void
+index_names(summary_store_t *store, struct file_summary *fs)
+{
+  GHashTableIter iter;
+  gpointer name;
+
+  g_hash_table_iter_init(&iter, fs->functions);
+  while (g_hash_table_iter_next(&iter, &name, NULL)) {
+    GPtrArray *defining = g_hash_table_lookup(store->names, name);
+
+    if (defining == NULL) {
+      defining = g_ptr_array_new();
+      g_hash_table_insert(store->names, g_strdup(name), defining);
+    }
+    g_ptr_array_add(defining, fs);
+  }
+}
+
+static guint64
+hash_functions(const struct summary_store_function *functions,
+               guint n_functions)
+{
+  guint64 hash = FNV_OFFSET;
+
+  for (guint i = 0; i < n_functions; i++) {
+    const guchar *b = (const guchar *) functions[i].name;
+    guint64 asserted = functions[i].asserted;
+
+    /* The nul ends the name */
+    do {
+      hash = (hash ^ *b) * FNV_PRIME;
+    } while (*b++ != '\0');
+    for (guint j = 0; j < sizeof(asserted); j++) {
+      hash = (hash ^ (asserted >> (8 * j) & 0xff)) * FNV_PRIME;
+    }
+  }
+  return hash;
+}
+
+void
+summary_store_replace(summary_store_t *store,
+                      const gchar *file,
+                      gint64 version,
+                      GCancellable *cancellable,
+                      const struct summary_store_function *functions,
+                      guint n_functions)
+{
+  struct file_summary *fs;
+  guint64 hash;
+
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(file != NULL);
+  g_return_if_fail(functions != NULL || n_functions == 0);
+
+  hash = hash_functions(functions, n_functions);
+
+  g_mutex_lock(&store->lock);
+  /* Checked under the lock, summary_store_forget() comes after the cancel */
+  if (g_cancellable_is_cancelled(cancellable)) {
+    goto out;
+  }
+  fs = g_hash_table_lookup(store->files, file);
+  if (fs == NULL) {
+    if (n_functions == 0) {
+      goto out;
+    }
+    fs = g_new0(struct file_summary, 1);
+    fs->functions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          g_free);
+    g_hash_table_insert(store->files, g_strdup(file), fs);
+  } else {
+    if (fs->version > version) {
+      goto out;
+    }
+    fs->version = version;
+    if (fs->hash == hash) {
+      /* The definitions did not change */
+      goto out;
+    }
+    unindex(store, fs);
+    g_hash_table_remove_all(fs->functions);
+  }
+
+  fs->version = version;
+  fs->hash = hash;
+  for (guint i = 0; i < n_functions; i++) {
+    guint64 *asserted = g_hash_table_lookup(fs->functions,
+                                            functions[i].name);
+
+    if (asserted != NULL) {
+      /* Defined more than once, as in the branches of an #ifdef */
+      *asserted &= functions[i].asserted;
+      continue;
+    }
+    g_hash_table_insert(fs->functions, g_strdup(functions[i].name),
+                        g_memdup2(&functions[i].asserted, sizeof(guint64)));
+  }
+  index_names(store, fs);
+  store->stats.updates++;
+
+  /* Fall through */
+out:
+  g_mutex_unlock(&store->lock);
+}
+
+void
+summary_store_forget(summary_store_t *store, const gchar *file)
+{
+  struct file_summary *fs;
+
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(file != NULL);
+
+  g_mutex_lock(&store->lock);
+  fs = g_hash_table_lookup(store->files, file);
+  if (fs != NULL) {
+    unindex(store, fs);
+    g_hash_table_remove(store->files, file);
+  }
+  g_mutex_unlock(&store->lock);
+}
+
+void
+summary_store_get_stats(summary_store_t *store,
+                        struct summary_store_stats *stats)
+{
+  g_return_if_fail(store != NULL);
+  g_return_if_fail(stats != NULL);
+
+  g_mutex_lock(&store->lock);
+  *stats = store->stats;
+  stats->entries = g_hash_table_size(store->names);
+  g_mutex_unlock(&store->lock);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Which parameters the functions of all analyzed files assert, by function
+ * name, so that callers in other files can rely on it. Only functions
+ * visible outside of their file are kept. */
+typedef struct summary_store summary_store_t;
+
+/* Parameters past the first 64 are never known to be asserted */
+#define SUMMARY_STORE_MAX_PARAMS 64
+
+struct summary_store_function {
+  const gchar *name;
+  /* Bit i is set for every asserted parameter i */
+  guint64 asserted;
+};
+
+struct summary_store_stats {
+  guint64 lookups;
+  guint64 hits;
+  /* Summaries of files that changed, a file seen again unchanged does not
+   * count */
+  guint64 updates;
+  /* Function names held now */
+  guint64 entries;
+};
+
+summary_store_t *summary_store_new(void);
+
+void summary_store_free(summary_store_t *store);
+
+/* asserted gets bit i set for every parameter i of name asserted by all of
+ * its definitions. FALSE if no file defines name. */
+gboolean summary_store_lookup(summary_store_t *store,
+                              const gchar *name,
+                              guint64 *asserted);
+
+/* Replaces what version of file defines with functions, names it no longer
+ * defines are dropped. Older versions never replace newer ones, and nothing
+ * is replaced once cancellable is cancelled. */
+void summary_store_replace(summary_store_t *store,
+                           const gchar *file,
+                           gint64 version,
+                           GCancellable *cancellable,
+                           const struct summary_store_function *functions,
+                           guint n_functions);
+
+/* Drops everything file defines, for a reopened file whose versions start
+ * over. Call after cancelling the analyses of the earlier session. */
+void summary_store_forget(summary_store_t *store, const gchar *file);
+
+void summary_store_get_stats(summary_store_t *store,
+                             struct summary_store_stats *stats);
+
+G_END_DECLS
@@ -0,0 +1,963 @@
+#include <glib.h>
+#include <string.h>
+#include <tree_sitter/api.h>
+
+#include "function_cache.h"
+#include "parse_utils.h"
+#include "parser.h"
+#include "visitor.h"
+
+const TSLanguage *tree_sitter_c(void);
+
+struct visit {
+  guint rule;
+  visit_func_t func;
+  gpointer user_data;
+};
+
+/* A text predicate of a pattern, #eq? or #match? and their #not- forms */
+struct predicate {
+  guint32 capture;
+  gboolean negated;
+  /* Capture compared to for #eq? @a @b, G_MAXUINT32 otherwise */
+  guint32 other;
+  /* Text compared to for #eq? @a "text" */
+  gchar *text;
+  gsize text_len;
+  /* For #match? */
+  GRegex *regex;
+};
+
+struct query_rule {
+  guint rule;
+  gchar *pattern;
+  gchar **captures;
+  /* Ids of captures in the compiled query */
+  guint32 capture_ids[VISITOR_MAX_CAPTURES];
+  /* struct predicate, NULL when the pattern has none */
+  GArray *predicates;
+  visit_match_func_t func;
+  gpointer user_data;
+};
+
+struct visitor {
+  /* GArray of struct visit by symbol, NULL when nobody is interested */
+  GArray **table;
+  guint symbols;
+  /* struct query_rule by pattern index */
+  GPtrArray *queries;
+  /* All patterns, read only once compiled */
+  TSQuery *query;
+  /* One more than the highest rule index */
+  guint rules;
+  /* Borrowed, NULL when results are not cached */
+  function_cache_t *cache;
+  /* visit_context_func_t by rule, NULL for rules without context */
+  visit_context_func_t *contexts;
+  guint n_contexts;
+};
+
+/* Owner of the problems not found on a top level node */
+#define NO_TOP G_MAXUINT32
+
+/* A top level node of the unit when caching */
+struct top {
+  guint32 start_byte;
+  guint32 end_byte;
+  /* Fingerprint of the node and its doc comment, which start at origin */
+  guint64 key;
+  TSPoint origin;
+  /* Some enabled rule still has to run on the node */
+  gboolean pending;
+};
+
+/* State of one walk */
+struct walk {
+  visitor_t *visitor;
+  const gboolean *enabled;
+  gint64 *times;
+  struct visit_ctx ctx;
+  /* Top level nodes of the unit, NULL when not caching */
+  struct top *tops;
+  guint n_tops;
+  /* By top and rule, the cache had the problems */
+  gboolean *hits;
+  /* By top and rule, the key of the problems in the cache */
+  guint64 *keys;
+  /* Top level node being walked */
+  guint top;
+  /* guint32 top of every problem the rules added from first on */
+  GArray *owners;
+  guint first;
+};
+
+G_DEFINE_QUARK("visitor-error-quark", visitor_error)
+
+static void
+predicate_clear(gpointer data)
+{
+  struct predicate *p = (struct predicate *) data;
+
+  g_free(p->text);
+  g_clear_pointer(&p->regex, g_regex_unref);
+}
+
+static void
+query_rule_free(gpointer data)
+{
+  struct query_rule *q = (struct query_rule *) data;
+
+  g_clear_pointer(&q->predicates, g_array_unref);
+  g_free(q->pattern);
+  g_strfreev(q->captures);
+  g_free(q);
+}
+
+visitor_t *
+visitor_new(void)
+{
+  visitor_t *visitor;
+
+  visitor = g_new0(visitor_t, 1);
+  visitor->queries = g_ptr_array_new_with_free_func(query_rule_free);
+
+  return visitor;
+}
+
+void
+visitor_free(visitor_t *visitor)
+{
+  if (visitor == NULL) {
+    return;
+  }
+  for (guint i = 0; i < visitor->symbols; i++) {
+    if (visitor->table[i] != NULL) {
+      g_array_unref(visitor->table[i]);
+    }
+  }
+  g_free(visitor->table);
+  g_free(visitor->contexts);
+  g_ptr_array_unref(visitor->queries);
+  g_clear_pointer(&visitor->query, ts_query_delete);
+  g_free(visitor);
+}
+
+void
+visitor_add(visitor_t *visitor,
+            guint rule,
+            TSSymbol symbol,
+            visit_func_t func,
+            gpointer user_data)
+{
+  struct visit visit = {rule, func, user_data};
+
+  g_assert(visitor);
+  g_assert(func);
+
+  visitor->rules = MAX(visitor->rules, rule + 1);
+  if (symbol >= visitor->symbols) {
+    visitor->table = g_renew(GArray *, visitor->table, symbol + 1);
+    for (guint i = visitor->symbols; i <= symbol; i++) {
+      visitor->table[i] = NULL;
+    }
+    visitor->symbols = symbol + 1;
+  }
+  if (visitor->table[symbol] == NULL) {
+    visitor->table[symbol] = g_array_new(FALSE, FALSE, sizeof(struct visit));
+  }
+  g_array_append_val(visitor->table[symbol], visit);
+}
+
+void
+visitor_set_context(visitor_t *visitor,
+                    guint rule,
+                    visit_context_func_t func)
+{
+  g_assert(visitor);
+
+  visitor->rules = MAX(visitor->rules, rule + 1);
+  if (rule >= visitor->n_contexts) {
+    visitor->contexts = g_renew(visit_context_func_t, visitor->contexts,
+                                rule + 1);
+    for (guint i = visitor->n_contexts; i <= rule; i++) {
+      visitor->contexts[i] = NULL;
+    }
+    visitor->n_contexts = rule + 1;
+  }
+  visitor->contexts[rule] = func;
+}
+
+guint64
+visitor_context(visitor_t *visitor,
+                guint rule,
+                parser_t *parser,
+                guint32 start_byte,
+                guint32 end_byte)
+{
+  g_assert(visitor);
+  g_assert(parser);
+
+  if (rule >= visitor->n_contexts || visitor->contexts[rule] == NULL) {
+    return 0;
+  }
+  return visitor->contexts[rule](parser, start_byte, end_byte);
+}
+
+void
+visitor_add_query(visitor_t *visitor,
+                  guint rule,
+                  const gchar *pattern,
+                  const gchar *const *captures,
+                  visit_match_func_t func,
+                  gpointer user_data)
+{
+  struct query_rule *q;
+
+  g_assert(visitor);
+  g_assert(pattern);
+  g_assert(captures);
+  g_assert(func);
+  g_assert(g_strv_length((gchar **) captures) <= VISITOR_MAX_CAPTURES);
+
+  q = g_new0(struct query_rule, 1);
+  q->rule = rule;
+  q->pattern = g_strdup(pattern);
+  q->captures = g_strdupv((gchar **) captures);
+  q->func = func;
+  q->user_data = user_data;
+  g_ptr_array_add(visitor->queries, q);
+  visitor->rules = MAX(visitor->rules, rule + 1);
+
+  /* Needs compiling again */
+  g_clear_pointer(&visitor->query, ts_query_delete);
+}
+
+void
+visitor_set_cache(visitor_t *visitor, function_cache_t *cache)
+{
+  g_assert(visitor);
+
+  visitor->cache = cache;
+}
+
+static guint32
+capture_id(TSQuery *query, const gchar *name)
+{
+  for (guint32 i = 0; i < ts_query_capture_count(query); i++) {
+    guint32 len;
+    const gchar *current = ts_query_capture_name_for_id(query, i, &len);
+
+    if (strlen(name) == len && strncmp(current, name, len) == 0) {
+      return i;
+    }
+  }
+  return G_MAXUINT32;
+}
+
+/* Appends the predicates of pattern of query to res, FALSE if one is not
+ * supported */
+static gboolean
+parse_predicates(const TSQuery *query,
+                 guint32 pattern,
+                 GArray *res,
+                 GError **err)
+{
+  const TSQueryPredicateStep *steps;
+  guint32 n_steps;
+  guint32 i = 0;
+
+  g_assert(query);
+  g_assert(res);
+  g_assert(err == NULL || *err == NULL);
+
+  steps = ts_query_predicates_for_pattern(query, pattern, &n_steps);
+  while (i < n_steps) {
+    struct predicate p = {0};
+    const gchar *name;
+    const gchar *arg;
+    guint32 len;
+    guint32 n_args = 0;
+
+    while (i + 1 + n_args < n_steps &&
+           steps[i + 1 + n_args].type != TSQueryPredicateStepTypeDone) {
+      n_args++;
+    }
+    name = ts_query_string_value_for_id(query, steps[i].value_id, &len);
+    if (n_args != 2 || steps[i + 1].type != TSQueryPredicateStepTypeCapture) {
+      g_set_error(err, VISITOR_ERROR, -1,
+                  "Predicate #%s takes a capture and a string or capture",
+                  name);
+      return FALSE;
+    }
+
+    p.capture = steps[i + 1].value_id;
+    p.other = G_MAXUINT32;
+    p.negated = g_str_has_prefix(name, "not-");
+    if (p.negated) {
+      name += strlen("not-");
+    }
+    if (g_str_equal(name, "eq?")) {
+      if (steps[i + 2].type == TSQueryPredicateStepTypeCapture) {
+        p.other = steps[i + 2].value_id;
+      } else {
+        arg = ts_query_string_value_for_id(query, steps[i + 2].value_id, &len);
+        p.text = g_strndup(arg, len);
+        p.text_len = len;
+      }
+    } else if (g_str_equal(name, "match?") &&
+               steps[i + 2].type == TSQueryPredicateStepTypeString) {
+      arg = ts_query_string_value_for_id(query, steps[i + 2].value_id, &len);
+      p.regex = g_regex_new(arg, G_REGEX_OPTIMIZE, 0, err);
+      if (p.regex == NULL) {
+        return FALSE;
+      }
+    } else {
+      g_set_error(err, VISITOR_ERROR, -1, "Unsupported predicate #%s%s",
+                  p.negated ? "not-" : "", name);
+      return FALSE;
+    }
+    g_array_append_val(res, p);
+    /* The name, the arguments and the end */
+    i += n_args + 2;
+  }
+  return TRUE;
+}
+
+gboolean
+visitor_query_check(const gchar *pattern,
+                    const gchar *const *captures,
+                    GError **err)
+{
+  TSQuery *query;
+  GArray *predicates = NULL;
+  guint32 offset = 0;
+  TSQueryError error = TSQueryErrorNone;
+  gboolean res = FALSE;
+
+  g_return_val_if_fail(pattern != NULL, FALSE);
+  g_return_val_if_fail(captures != NULL, FALSE);
+  g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+  parse_utils_init();
+  query = ts_query_new(tree_sitter_c(), pattern, strlen(pattern), &offset,
+                       &error);
+  if (query == NULL) {
+    g_set_error(err, VISITOR_ERROR, error, "Query error %d at: %.40s", error,
+                pattern + offset);
+    return FALSE;
+  }
+  if (ts_query_pattern_count(query) != 1) {
+    g_set_error(err, VISITOR_ERROR, -1,
+                "Query should hold exactly one pattern");
+    goto out;
+  }
+  if (g_strv_length((gchar **) captures) > VISITOR_MAX_CAPTURES) {
+    g_set_error(err, VISITOR_ERROR, -1, "Query uses more than %d captures",
+                VISITOR_MAX_CAPTURES);
+    goto out;
+  }
+  for (guint i = 0; captures[i] != NULL; i++) {
+    if (capture_id(query, captures[i]) == G_MAXUINT32) {
+      g_set_error(err, VISITOR_ERROR, -1, "Query has no capture @%s",
+                  captures[i]);
+      goto out;
+    }
+  }
+
+  predicates = g_array_new(FALSE, FALSE, sizeof(struct predicate));
+  g_array_set_clear_func(predicates, predicate_clear);
+  res = parse_predicates(query, 0, predicates, err);
+
+  /* Fall through */
+out:
+  if (predicates != NULL) {
+    g_array_unref(predicates);
+  }
+  ts_query_delete(query);
+  return res;
+}
+
+gboolean
+visitor_compile(visitor_t *visitor)
+{
+  GString *source;
+  guint32 offset = 0;
+  TSQueryError error = TSQueryErrorNone;
+  gboolean res = FALSE;
+
+  g_assert(visitor);
+
+  parse_utils_init();
+  g_clear_pointer(&visitor->query, ts_query_delete);
+  if (visitor->queries->len == 0) {
+    return TRUE;
+  }
+
+  source = g_string_new(NULL);
+  for (guint i = 0; i < visitor->queries->len; i++) {
+    struct query_rule *q = g_ptr_array_index(visitor->queries, i);
+
+    g_string_append(source, q->pattern);
+    g_string_append_c(source, '\n');
+  }
+
+  visitor->query = ts_query_new(tree_sitter_c(), source->str, source->len,
+                                &offset, &error);
+  if (visitor->query == NULL) {
+    g_warning("Could not compile rule queries, error %d at: %.40s", error,
+              source->str + offset);
+    goto out;
+  }
+  if (ts_query_pattern_count(visitor->query) != visitor->queries->len) {
+    g_warning("Rule queries should hold exactly one pattern each");
+    g_clear_pointer(&visitor->query, ts_query_delete);
+    goto out;
+  }
+
+  for (guint i = 0; i < visitor->queries->len; i++) {
+    struct query_rule *q = g_ptr_array_index(visitor->queries, i);
+    GError *err = NULL;
+    guint32 n_steps;
+
+    for (guint j = 0; q->captures[j] != NULL; j++) {
+      q->capture_ids[j] = capture_id(visitor->query, q->captures[j]);
+    }
+
+    g_clear_pointer(&q->predicates, g_array_unref);
+    /* Most patterns have none and cost nothing when matching */
+    ts_query_predicates_for_pattern(visitor->query, i, &n_steps);
+    if (n_steps == 0) {
+      continue;
+    }
+    q->predicates = g_array_new(FALSE, FALSE, sizeof(struct predicate));
+    g_array_set_clear_func(q->predicates, predicate_clear);
+    if (!parse_predicates(visitor->query, i, q->predicates, &err)) {
+      g_warning("Could not compile rule query %s: %s", q->pattern,
+                err->message);
+      g_clear_error(&err);
+      g_clear_pointer(&visitor->query, ts_query_delete);
+      goto out;
+    }
+  }
+  res = TRUE;
+
+  /* Fall through */
+out:
+  g_string_free(source, TRUE);
+  return res;
+}
+
+/* Remembers the problems added from before on as found on top */
+static void
+set_owner(struct walk *w, guint before, guint32 top)
+{
+  guint len = problems_len(w->ctx.problems);
+
+  if (w->owners == NULL || len == before) {
+    return;
+  }
+  g_array_set_size(w->owners, len - w->first);
+  for (guint i = before; i < len; i++) {
+    g_array_index(w->owners, guint32, i - w->first) = top;
+  }
+}
+
+static void
+dispatch(struct walk *w, TSNode n)
+{
+  TSSymbol symbol = ts_node_symbol(n);
+  GArray *visits;
+  guint before;
+
+  if (symbol >= w->visitor->symbols) {
+    return;
+  }
+  visits = w->visitor->table[symbol];
+  if (visits == NULL) {
+    return;
+  }
+
+  for (guint i = 0; i < visits->len; i++) {
+    struct visit *visit = &g_array_index(visits, struct visit, i);
+    gint64 start;
+
+    if (w->enabled != NULL && !w->enabled[visit->rule]) {
+      continue;
+    }
+    if (w->tops != NULL && w->hits[w->top * w->visitor->rules + visit->rule]) {
+      continue;
+    }
+    before = problems_len(w->ctx.problems);
+    w->ctx.problems->rule = visit->rule;
+    if (w->times == NULL) {
+      visit->func(&w->ctx, n, visit->user_data);
+    } else {
+      start = g_get_monotonic_time();
+      visit->func(&w->ctx, n, visit->user_data);
+      w->times[visit->rule] += g_get_monotonic_time() - start;
+    }
+    set_owner(w, before, w->top);
+  }
+}
+
+/* Visits the node under the cursor and everything below it, FALSE if the
+ * analysis was cancelled. The cursor is back on the node when it returns. */
+static gboolean
+walk_node(struct walk *w, TSTreeCursor *cursor)
+{
+  TSNode n;
+  TSNode prev = {0};
+
+  g_assert(w);
+  g_assert(cursor);
+
+  n = ts_tree_cursor_current_node(cursor);
+  if (ts_node_symbol(n) == SYMBOL_FUNCTION &&
+      parser_is_cancelled(w->ctx.parser)) {
+    return FALSE;
+  }
+
+  dispatch(w, n);
+
+  if (!parse_utils_cursor_first_named_child(cursor)) {
+    return TRUE;
+  }
+  w->ctx.depth++;
+  do {
+    w->ctx.prev = prev;
+    if (!walk_node(w, cursor)) {
+      return FALSE;
+    }
+    prev = ts_tree_cursor_current_node(cursor);
+  } while (parse_utils_cursor_next_named_sibling(cursor));
+  w->ctx.depth--;
+  ts_tree_cursor_goto_parent(cursor);
+
+  return TRUE;
+}
+
+/* Byte range of the top level nodes of a unit, everything for a whole file */
+static void
+unit_range(parser_t *parser, guint32 *start, guint32 *end)
+{
+  const node_table_t *nodes = parser->nodes;
+  const struct node_entry *entries;
+  guint32 child = 1;
+  guint count;
+
+  g_assert(start);
+  g_assert(end);
+
+  *start = 0;
+  *end = G_MAXUINT32;
+  if (parser->whole == NULL || nodes == NULL) {
+    return;
+  }
+
+  entries = (const struct node_entry *) nodes->entries->data;
+  count = parser_unit_end(parser);
+  for (guint i = 0; i < count && child < entries[0].end; i++) {
+    if (i == parser->unit_start) {
+      *start = entries[child].start_byte;
+    }
+    if (i + 1 == count) {
+      *end = entries[child].end_byte;
+    }
+    child = entries[child].end;
+  }
+}
+
+static gboolean
+rule_enabled(struct walk *w, guint rule)
+{
+  return w->enabled == NULL || w->enabled[rule];
+}
+
+/* Top level node of the match starting at n, NO_TOP if it is not kept
+ * per node. FALSE if the cache already has the problems of rule there. */
+static gboolean
+match_top(struct walk *w, guint rule, TSNode n, guint32 *top)
+{
+  guint32 start;
+  guint low = 0;
+  guint high;
+
+  *top = NO_TOP;
+  if (w->tops == NULL || ts_node_is_null(n)) {
+    return TRUE;
+  }
+
+  start = ts_node_start_byte(n);
+  high = w->n_tops;
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (w->tops[mid].end_byte <= start) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == w->n_tops || w->tops[low].start_byte > start) {
+    return TRUE;
+  }
+  *top = low;
+  return !w->hits[low * w->visitor->rules + rule];
+}
+/* Node of the match captured as capture, null if there is none */
+static TSNode
+match_capture(const TSQueryMatch *match, guint32 capture)
+{
+  TSNode none = {0};
+
+  for (guint k = 0; k < match->capture_count; k++) {
+    if (match->captures[k].index == capture) {
+      return match->captures[k].node;
+    }
+  }
+  return none;
+}
+
+/* TRUE if the text of the captures satisfies every predicate of q */
+static gboolean
+predicates_hold(struct walk *w,
+                const struct query_rule *q,
+                const TSQueryMatch *match)
+{
+  const gchar *content = w->ctx.parser->content;
+
+  for (guint i = 0; i < q->predicates->len; i++) {
+    const struct predicate *p;
+    const gchar *text;
+    gsize len;
+    TSNode n;
+    gboolean holds;
+
+    p = &g_array_index(q->predicates, struct predicate, i);
+    n = match_capture(match, p->capture);
+    if (ts_node_is_null(n)) {
+      return FALSE;
+    }
+    text = content + ts_node_start_byte(n);
+    len = ts_node_end_byte(n) - ts_node_start_byte(n);
+
+    if (p->regex != NULL) {
+      holds = g_regex_match_full(p->regex, text, len, 0, 0, NULL, NULL);
+    } else if (p->other != G_MAXUINT32) {
+      TSNode o = match_capture(match, p->other);
+
+      if (ts_node_is_null(o)) {
+        return FALSE;
+      }
+      holds = ts_node_end_byte(o) - ts_node_start_byte(o) == len &&
+              memcmp(content + ts_node_start_byte(o), text, len) == 0;
+    } else {
+      holds = p->text_len == len && memcmp(p->text, text, len) == 0;
+    }
+    if (holds == p->negated) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* Runs the queries on the matches whose first capture is in [start, end) */
+static void
+run_query_range(struct walk *w,
+                TSQueryCursor *cursor,
+                guint32 start,
+                guint32 end)
+{
+  parser_t *parser = w->ctx.parser;
+  TSQueryMatch match;
+  TSNode none = {0};
+
+  ts_query_cursor_set_byte_range(cursor, start, end);
+  ts_query_cursor_exec(cursor, w->visitor->query, parser->root_node);
+
+  while (ts_query_cursor_next_match(cursor, &match) &&
+         !parser_is_cancelled(parser)) {
+    struct query_rule *q;
+    TSNode captures[VISITOR_MAX_CAPTURES];
+    guint32 top;
+    guint before;
+    gint64 time;
+
+    q = g_ptr_array_index(w->visitor->queries, match.pattern_index);
+    if (!rule_enabled(w, q->rule)) {
+      continue;
+    }
+
+    for (guint j = 0; q->captures[j] != NULL; j++) {
+      captures[j] = match_capture(&match, q->capture_ids[j]);
+    }
+    /* Matches belong to the unit holding their first capture */
+    if (q->captures[0] != NULL && !ts_node_is_null(captures[0]) &&
+        (ts_node_start_byte(captures[0]) < start ||
+         ts_node_start_byte(captures[0]) >= end)) {
+      continue;
+    }
+    if (!match_top(w, q->rule, q->captures[0] != NULL ? captures[0] : none,
+                   &top)) {
+      continue;
+    }
+    if (q->predicates != NULL && !predicates_hold(w, q, &match)) {
+      continue;
+    }
+
+    before = problems_len(w->ctx.problems);
+    w->ctx.problems->rule = q->rule;
+    if (w->times == NULL) {
+      q->func(&w->ctx, captures, q->user_data);
+    } else {
+      time = g_get_monotonic_time();
+      q->func(&w->ctx, captures, q->user_data);
+      w->times[q->rule] += g_get_monotonic_time() - time;
+    }
+    set_owner(w, before, top);
+  }
+}
+
+static void
+run_queries(struct walk *w)
+{
+  TSQueryCursor *cursor;
+  TSNode none = {0};
+  guint32 start;
+  guint32 end;
+
+  w->ctx.depth = 0;
+  w->ctx.prev = none;
+  cursor = ts_query_cursor_new();
+
+  if (w->tops == NULL) {
+    unit_range(w->ctx.parser, &start, &end);
+    run_query_range(w, cursor, start, end);
+    goto out;
+  }
+
+  /* Only over the runs of top level nodes the cache does not know */
+  for (guint t = 0; t < w->n_tops; t++) {
+    guint last = t;
+
+    if (!w->tops[t].pending) {
+      continue;
+    }
+    while (last + 1 < w->n_tops && w->tops[last + 1].pending) {
+      last++;
+    }
+    run_query_range(w, cursor, w->tops[t].start_byte,
+                    w->tops[last].end_byte);
+    t = last;
+  }
+
+  /* Fall through */
+out:
+  ts_query_cursor_delete(cursor);
+}
+
+/* Fingerprints the top level nodes of the unit and takes the problems of
+ * every enabled rule the cache knows */
+static void
+prepare_tops(struct walk *w)
+{
+  parser_t *parser = w->ctx.parser;
+  const struct node_entry *entries;
+  guint rules = w->visitor->rules;
+  guint32 child = 1;
+  guint count;
+
+  entries = (const struct node_entry *) parser->nodes->entries->data;
+  count = parser_unit_end(parser);
+
+  w->tops = g_new0(struct top, count - parser->unit_start);
+  w->hits = g_new0(gboolean, (count - parser->unit_start) * rules);
+  w->keys = g_new0(guint64, (count - parser->unit_start) * rules);
+
+  for (guint i = 0; i < count && child < entries[0].end;
+       i++, child = entries[child].end) {
+    struct top *top;
+    gboolean *hits;
+    guint64 *keys;
+    guint32 span;
+    gint32 prev;
+
+    if (i < parser->unit_start) {
+      continue;
+    }
+    top = &w->tops[w->n_tops];
+    hits = &w->hits[w->n_tops * rules];
+    keys = &w->keys[w->n_tops * rules];
+    w->n_tops++;
+
+    top->start_byte = entries[child].start_byte;
+    top->end_byte = entries[child].end_byte;
+    top->origin = ts_node_start_point(node_table_node(parser->nodes, child));
+    span = top->start_byte;
+
+    /* The doc comment is part of what rules look at */
+    prev = entries[child].prev;
+    if (prev >= 0 && entries[prev].symbol == SYMBOL_COMMENT) {
+      span = entries[prev].start_byte;
+      top->origin = ts_node_start_point(node_table_node(parser->nodes, prev));
+    }
+    top->key = function_cache_hash(parser->content + span,
+                                   top->end_byte - span);
+
+    for (guint r = 0; r < rules; r++) {
+      if (!rule_enabled(w, r)) {
+        continue;
+      }
+      keys[r] = top->key;
+      if (r < w->visitor->n_contexts && w->visitor->contexts[r] != NULL) {
+        guint64 mix[2];
+
+        mix[0] = top->key;
+        mix[1] = w->visitor->contexts[r](parser, top->start_byte,
+                                         top->end_byte);
+        keys[r] = function_cache_hash((const gchar *) mix, sizeof(mix));
+      }
+      hits[r] = function_cache_lookup(w->visitor->cache, keys[r], r,
+                                      top->origin, w->ctx.problems);
+      top->pending |= !hits[r];
+    }
+  }
+
+  /* What the rules add from here on is stored by owner */
+  w->owners = g_array_new(FALSE, FALSE, sizeof(guint32));
+  w->first = problems_len(w->ctx.problems);
+}
+
+/* Stores what the rules found on every top level node they ran on, unless
+ * the analysis was cancelled */
+static void
+finish_tops(struct walk *w)
+{
+  guint rules = w->visitor->rules;
+  guint n_slots = w->n_tops * rules;
+  guint *starts;
+  guint *order;
+
+  if (parser_is_cancelled(w->ctx.parser)) {
+    goto out;
+  }
+
+  /* Problems grouped by top and rule, in the order they were found */
+  starts = g_new0(guint, n_slots + 1);
+  order = g_new(guint, w->owners->len + 1);
+  for (guint i = 0; i < w->owners->len; i++) {
+    guint32 top = g_array_index(w->owners, guint32, i);
+
+    if (top != NO_TOP) {
+      starts[top * rules + problems_get(w->ctx.problems, w->first + i)->rule +
+             1]++;
+    }
+  }
+  for (guint i = 0; i < n_slots; i++) {
+    starts[i + 1] += starts[i];
+  }
+  for (guint i = 0; i < w->owners->len; i++) {
+    guint32 top = g_array_index(w->owners, guint32, i);
+    guint slot;
+
+    if (top == NO_TOP) {
+      continue;
+    }
+    slot = top * rules + problems_get(w->ctx.problems, w->first + i)->rule;
+    order[starts[slot]++] = w->first + i;
+  }
+  /* starts[slot] is now the end of slot */
+
+  for (guint t = 0; t < w->n_tops; t++) {
+    for (guint r = 0; r < rules; r++) {
+      guint slot = t * rules + r;
+      guint start = slot > 0 ? starts[slot - 1] : 0;
+
+      if (!rule_enabled(w, r) || w->hits[slot]) {
+        continue;
+      }
+      function_cache_store(w->visitor->cache, w->keys[slot], r,
+                           w->tops[t].origin, w->ctx.problems, order + start,
+                           starts[slot] - start);
+    }
+  }
+  g_free(starts);
+  g_free(order);
+
+  /* Fall through */
+out:
+  g_array_unref(w->owners);
+  g_free(w->tops);
+  g_free(w->hits);
+  g_free(w->keys);
+}
+
+void
+visitor_run(visitor_t *visitor,
+            parser_t *parser,
+            const gboolean *enabled,
+            gint64 *times,
+            problems_t *problems)
+{
+  struct walk w = {0};
+  TSTreeCursor cursor;
+  TSNode prev = {0};
+  guint end;
+
+  g_assert(visitor);
+  g_assert(parser);
+  g_assert(problems);
+
+  if (parser->tree == NULL) {
+    return;
+  }
+
+  w.visitor = visitor;
+  w.enabled = enabled;
+  w.times = times;
+  w.ctx.parser = parser;
+  w.ctx.depth = 1;
+  w.ctx.problems = problems;
+  w.top = NO_TOP;
+
+  if (visitor->cache != NULL && parser->nodes != NULL) {
+    prepare_tops(&w);
+  }
+
+  if (visitor->query != NULL) {
+    run_queries(&w);
+  }
+  if (visitor->symbols == 0) {
+    goto done;
+  }
+
+  end = parser_unit_end(parser);
+  cursor = ts_tree_cursor_new(parser->root_node);
+  if (!parse_utils_cursor_first_named_child(&cursor)) {
+    goto out;
+  }
+  for (guint i = 0; i < end; i++) {
+    if (i >= parser->unit_start) {
+      if (w.tops != NULL) {
+        w.top = i - parser->unit_start;
+      }
+      w.ctx.prev = prev;
+      if ((w.tops == NULL || w.tops[i - parser->unit_start].pending) &&
+          !walk_node(&w, &cursor)) {
+        break;
+      }
+    }
+    prev = ts_tree_cursor_current_node(&cursor);
+    if (!parse_utils_cursor_next_named_sibling(&cursor)) {
+      break;
+    }
+  }
+
+  /* Fall through */
+out:
+  ts_tree_cursor_delete(&cursor);
+done:
+  if (w.tops != NULL) {
+    finish_tops(&w);
+  }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+#include "function_cache.h"
+#include "parser.h"
+#include "problems.h"
+
+G_BEGIN_DECLS
+
+/* Walks a tree once and hands every node to the rules that registered for
+ * its symbol, then runs the tree-sitter queries of all rules in one pass */
+typedef struct visitor visitor_t;
+
+#define VISITOR_ERROR visitor_error_quark()
+
+/* Most captures a query rule can ask for */
+#define VISITOR_MAX_CAPTURES 8
+
+struct visit_ctx {
+  parser_t *parser;
+  /* Depth of the visited node, top level nodes are at 1, 0 for queries */
+  guint depth;
+  /* Previous named sibling of the visited node, null for the first child
+   * and for queries */
+  TSNode prev;
+  /* Problems of the analysis, callbacks add to it under the rule that is
+   * running */
+  problems_t *problems;
+};
+
+typedef void (*visit_func_t)(struct visit_ctx *v, TSNode n, gpointer user_data);
+
+/* Gets the captured nodes in the order their names were registered, null
+ * nodes for the ones the match did not capture */
+typedef void (*visit_match_func_t)(struct visit_ctx *v,
+                                   const TSNode *captures,
+                                   gpointer user_data);
+
+/* Fingerprint of what a rule looks at outside of the top level node
+ * [start_byte, end_byte) of parser */
+typedef guint64 (*visit_context_func_t)(parser_t *parser,
+                                        guint32 start_byte,
+                                        guint32 end_byte);
+
+/* Registers the callbacks of a rule under the given rule index */
+typedef void (*visitor_register_func_t)(visitor_t *visitor, guint rule);
+
+visitor_t *visitor_new(void);
+
+void visitor_free(visitor_t *visitor);
+
+void visitor_add(visitor_t *visitor,
+                 guint rule,
+                 TSSymbol symbol,
+                 visit_func_t func,
+                 gpointer user_data);
+
+/* Adds a query of a single pattern, captures is NULL terminated. Matches
+ * failing its #eq? or #match? predicates are skipped. */
+void visitor_add_query(visitor_t *visitor,
+                       guint rule,
+                       const gchar *pattern,
+                       const gchar *const *captures,
+                       visit_match_func_t func,
+                       gpointer user_data);
+
+/* Checks that pattern compiles to a single pattern holding the captures and
+ * only the predicates the visitor evaluates: #eq?, #match? and their #not-
+ * forms */
+gboolean visitor_query_check(const gchar *pattern,
+                             const gchar *const *captures,
+                             GError **err);
+
+/* Compiles the queries of all rules into one, call after registering and
+ * before the visitor is shared. FALSE if a pattern does not compile. */
+gboolean visitor_compile(visitor_t *visitor);
+
+/* Reuses the problems of top level nodes found in earlier runs. The cache is
+ * borrowed, set it before the visitor is shared. */
+void visitor_set_cache(visitor_t *visitor, function_cache_t *cache);
+
+/* Problems of the rule are only taken from the cache while the context of
+ * their top level node is the same */
+void visitor_set_context(visitor_t *visitor,
+                         guint rule,
+                         visit_context_func_t func);
+
+/* Context of rule over [start_byte, end_byte) of parser, 0 for rules
+ * without one */
+guint64 visitor_context(visitor_t *visitor,
+                        guint rule,
+                        parser_t *parser,
+                        guint32 start_byte,
+                        guint32 end_byte);
+
+/* Walks the unit of parser adding to problems, enabled and times are indexed
+ * by rule and may be NULL for all rules and no timing */
+void visitor_run(visitor_t *visitor,
+                 parser_t *parser,
+                 const gboolean *enabled,
+                 gint64 *times,
+                 problems_t *problems);
+
+GQuark visitor_error_quark(void);
+
+G_END_DECLS
@@ -0,0 +1,10 @@
+#include <glib.h>
+
+static void
+split(gpointer name, gpointer other) {
+  /* Name is optional */
+  /* May be NULL */
+  /* OTHER may be Null */
+
+  g_print("name: %p %p\n", name, other);
+}
@@ -0,0 +1,39 @@
+#include <glib.h>
+
+gint
+checked(gchar *str, gint *out)
+{
+  g_assert(str);
+
+  return strlen(str);
+}
+
+static gint
+forwards(gchar *text)
+{
+  return checked(text, NULL);
+}
+
+static gint
+forwards_cast(gpointer data)
+{
+  return checked((gchar *) data, NULL);
+}
+
+static gint
+forwards_twice(gchar *text)
+{
+  return forwards(text);
+}
+
+static void
+forwards_unchecked(gint *value)
+{
+  checked("", value);
+}
+
+static gint
+recursive(gchar *text, guint depth)
+{
+  return depth > 0 ? recursive(text, depth - 1) : 0;
+}
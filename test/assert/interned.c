@@ -0,0 +1,11 @@
+#include <glib.h>
+
+static void
+ids(gpointer name, gpointer other) {
+  GObject *info = G_OBJECT(name);
+
+  g_assert(info);
+  g_assert(other_name);
+
+  g_print("name: %p %p\n", name, other);
+}
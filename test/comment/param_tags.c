@@ -0,0 +1,19 @@
+#include <glib.h>
+
+/**
+ * @brief Directions of parameters
+ *
+ * @param[in] src
+ * @param[out] dest
+ * @param[in,out] len
+ * @returns TRUE on success
+ */
+gboolean copies(const gchar *src, gchar *dest, gsize *len);
+
+/**
+ * @brief Names only count on the line of their tag
+ *
+ * @param
+ *   self
+ */
+void split_line(gpointer self);
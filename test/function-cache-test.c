@@ -0,0 +1,238 @@
+#include <glib.h>
+#include <string.h>
+
+#include "function_cache.h"
+#include "message.h"
+#include "parser.h"
+#include "process_asserts.h"
+#include "process_comments.h"
+#include "process_midscope.h"
+#include "visitor.h"
+
+/* Problems taken from the cache should be those the rules find, wherever the
+ * declarations moved to */
+
+#define DECLARATIONS 40
+
+struct fixture {
+  GHashTable *files;
+  visitor_t *plain;
+  visitor_t *cached;
+  function_cache_t *cache;
+};
+
+static visitor_t *
+new_visitor(void)
+{
+  visitor_t *visitor = visitor_new();
+
+  process_asserts_register(visitor, 0);
+  process_midscope_register(visitor, 1);
+  process_comments_register(visitor, 2);
+  g_assert_true(visitor_compile(visitor));
+
+  return visitor;
+}
+
+static void
+fixture_set_up(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  f->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  f->plain = new_visitor();
+  f->cached = new_visitor();
+  f->cache = function_cache_new(1024);
+  visitor_set_cache(f->cached, f->cache);
+}
+
+static void
+fixture_tear_down(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  visitor_free(f->plain);
+  visitor_free(f->cached);
+  function_cache_free(f->cache);
+  g_hash_table_unref(f->files);
+}
+
+/* Every declaration has problems, shift moves declarations down and some
+ * of them right */
+static gchar *
+generate(gboolean shift)
+{
+  GString *s = g_string_new("#include <glib.h>\n\n");
+
+  if (shift) {
+    g_string_append(s, "gint added;\n\n\n");
+  }
+  for (guint i = 0; i < DECLARATIONS; i++) {
+    if (shift && i % 3 == 0) {
+      g_string_append(s, "gint moved_right; ");
+    }
+    switch (i % 3) {
+    case 0:
+      g_string_append_printf(s, "void undocumented_%u(gpointer self);\n\n",
+                             i);
+      break;
+    case 1:
+      g_string_append_printf(s,
+                             "/**\n"
+                             " * @brief Wrong %u\n"
+                             " *\n"
+                             " * @param other\n"
+                             " */\n"
+                             "gboolean wrong_%u(gpointer self);\n\n",
+                             i, i);
+      break;
+    default:
+      g_string_append_printf(s,
+                             "static gint\n"
+                             "helper_%u(gchar *str, gint *out)\n"
+                             "{\n"
+                             "  gint len;\n"
+                             "  len = strlen(str);\n"
+                             "  gint late = len;\n"
+                             "  return late;\n"
+                             "}\n\n",
+                             i);
+      break;
+    }
+  }
+
+  return g_string_free(s, FALSE);
+}
+
+static problems_t *
+run(struct fixture *f, visitor_t *visitor, const gchar *text)
+{
+  message_t *msg;
+  parser_t *parser;
+  problems_t *issues = problems_new();
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_OPEN;
+  msg->data.open.uri = g_strdup("file:///cache.c");
+  msg->data.open.text = g_strdup(text);
+  msg->data.open.version = 1;
+  msg->data.open.language = g_strdup("c");
+
+  parser = parser_new(msg, f->files);
+  visitor_run(visitor, parser, NULL, NULL, issues);
+  parser_unref(parser);
+  problems_sort(issues);
+
+  return issues;
+}
+
+static void
+assert_same(const problems_t *expected, const problems_t *got)
+{
+  GString *want = g_string_new(NULL);
+  GString *have = g_string_new(NULL);
+
+  g_assert_cmpuint(problems_len(got), ==, problems_len(expected));
+
+  for (guint i = 0; i < problems_len(expected); i++) {
+    const struct problem *e = problems_get(expected, i);
+    const struct problem *g = problems_get(got, i);
+
+    g_assert_cmpuint(g->start_line, ==, e->start_line);
+    g_assert_cmpuint(g->start_char, ==, e->start_char);
+    g_assert_cmpuint(g->end_line, ==, e->end_line);
+    g_assert_cmpuint(g->end_char, ==, e->end_char);
+    g_assert_cmpint(g->id, ==, e->id);
+    g_string_truncate(want, 0);
+    g_string_truncate(have, 0);
+    problems_format(expected, e, want);
+    problems_format(got, g, have);
+    g_assert_cmpstr(have->str, ==, want->str);
+  }
+
+  g_string_free(want, TRUE);
+  g_string_free(have, TRUE);
+}
+
+static void
+test_moved(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  struct function_cache_stats stats;
+  gchar *before = generate(FALSE);
+  gchar *after = generate(TRUE);
+  problems_t *expected;
+  problems_t *got;
+
+  expected = run(f, f->plain, before);
+  g_assert_cmpuint(problems_len(expected), >, 0);
+  got = run(f, f->cached, before);
+  assert_same(expected, got);
+  problems_free(expected);
+  problems_free(got);
+
+  function_cache_get_stats(f->cache, &stats);
+  g_assert_cmpuint(stats.hits, ==, 0);
+
+  expected = run(f, f->plain, after);
+  got = run(f, f->cached, after);
+  assert_same(expected, got);
+  problems_free(expected);
+  problems_free(got);
+
+  /* The include, the declarations and their doc comments hit for all three
+   * rules, only what was added runs again */
+  function_cache_get_stats(f->cache, &stats);
+  g_test_message("%lu hits of %lu lookups", stats.hits, stats.lookups);
+  g_assert_cmpuint(stats.hits, ==,
+                   (1 + DECLARATIONS + DECLARATIONS / 3) * 3);
+
+  g_free(before);
+  g_free(after);
+}
+
+/* The caller did not change, but what it passes its parameter to did */
+static void
+test_callee_changed(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  static const gchar *const texts[] = {
+    "gint\n"
+    "checked(gchar *str)\n"
+    "{\n"
+    "  g_assert(str);\n"
+    "  return 0;\n"
+    "}\n\n"
+    "static gint\n"
+    "forwards(gchar *text)\n"
+    "{\n"
+    "  return checked(text);\n"
+    "}\n",
+    "gint\n"
+    "checked(gchar *str)\n"
+    "{\n"
+    "  return 0;\n"
+    "}\n\n"
+    "static gint\n"
+    "forwards(gchar *text)\n"
+    "{\n"
+    "  return checked(text);\n"
+    "}\n",
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS(texts); i++) {
+    problems_t *expected = run(f, f->plain, texts[i]);
+    problems_t *got = run(f, f->cached, texts[i]);
+
+    assert_same(expected, got);
+    problems_free(expected);
+    problems_free(got);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add("/message/process/cache/moved", struct fixture, NULL,
+             fixture_set_up, test_moved, fixture_tear_down);
+  g_test_add("/message/process/cache/callee_changed", struct fixture, NULL,
+             fixture_set_up, test_callee_changed, fixture_tear_down);
+
+  return g_test_run();
+}
@@ -0,0 +1,269 @@
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <tree_sitter/api.h>
+#include <unistd.h>
+
+#include "message.h"
+#include "parser.h"
+#include "process_asserts.h"
+#include "rules-helper.h"
+
+/* Analysing a function, from building the tables of the file to running the
+ * rule in the visitor of the server, should not allocate once per function,
+ * and analysing the same file over and over should leave the memory in use
+ * flat */
+
+#define SMALL 100
+#define LARGE 400
+#define HUGE 1600
+#define ANALYSES 100000
+#define WARMUP 1000
+/* Allowed growth of the resident set over the analyses, in kB */
+#define MAX_RSS_GROWTH 2048
+
+#ifdef __GLIBC__
+/* Count the allocations by interposing the allocator of the C library */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gint counting = 0;
+static gint allocations = 0;
+
+void *
+malloc(size_t size)
+{
+  if (g_atomic_int_get(&counting)) {
+    g_atomic_int_inc(&allocations);
+  }
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+  if (g_atomic_int_get(&counting)) {
+    g_atomic_int_inc(&allocations);
+  }
+  return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  if (g_atomic_int_get(&counting)) {
+    g_atomic_int_inc(&allocations);
+  }
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+/* Static functions asserting their parameters, directly, through a cast or
+ * as a GError, but one, so that each has a problem */
+static gchar *
+generate(guint functions)
+{
+  GString *s = g_string_new("#include <glib.h>\n\n");
+
+  for (guint i = 0; i < functions; i++) {
+    g_string_append_printf(s,
+                           "static gint\n"
+                           "helper_%u(gchar *str, gchar *name, "
+                           "gpointer data, GError **err)\n"
+                           "{\n"
+                           "  GObject *object = G_OBJECT(data);\n"
+                           "\n"
+                           "  g_assert(str);\n"
+                           "  g_assert(object);\n"
+                           "  g_assert(err == NULL || *err == NULL);\n"
+                           "\n"
+                           "  return strlen(str) + strlen(name);\n"
+                           "}\n\n",
+                           i);
+  }
+
+  return g_string_free(s, FALSE);
+}
+
+/* Not parsed yet */
+static parser_t *
+parser_for(const gchar *text, GHashTable *files)
+{
+  message_t *msg;
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_OPEN;
+  msg->data.open.uri = g_strdup("file:///alloc.c");
+  msg->data.open.text = g_strdup(text);
+  msg->data.open.version = 1;
+  msg->data.open.language = g_strdup("c");
+
+  return parser_new_deferred(msg, files);
+}
+
+#ifdef __GLIBC__
+/* Allocations of parsing text into the tables of the server and running the
+ * asserts rule over it in visitor. The nodes tree-sitter allocates are not
+ * counted, see main(). */
+static gint
+count_allocations(visitor_t *visitor,
+                  const gboolean *enabled,
+                  const gchar *text,
+                  GHashTable *files,
+                  guint functions)
+{
+  parser_t *parser;
+  problems_t *issues;
+  gint res;
+
+  parser = parser_for(text, files);
+  issues = problems_new();
+
+  g_atomic_int_set(&allocations, 0);
+  g_atomic_int_set(&counting, 1);
+  parser_parse(parser);
+  parser_get_functions(parser);
+  visitor_run(visitor, parser, enabled, NULL, issues);
+  g_atomic_int_set(&counting, 0);
+  res = g_atomic_int_get(&allocations);
+
+  g_assert_cmpuint(problems_len(issues), ==, functions);
+  problems_free(issues);
+  parser_unref(parser);
+
+  return res;
+}
+#endif
+
+static void
+test_allocations(void)
+{
+#ifdef __GLIBC__
+  GHashTable *files;
+  visitor_t *visitor;
+  gboolean *enabled;
+  gchar *small;
+  gchar *large;
+  gchar *huge;
+  gint small_count;
+  gint large_count;
+  gint huge_count;
+
+  files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  /* Without a cache, which keeps the problems of every function by design */
+  visitor = rules_helper_visitor_new(NULL);
+  enabled = rules_helper_enabled(process_asserts_register);
+  small = generate(SMALL);
+  large = generate(LARGE);
+  huge = generate(HUGE);
+
+  /* Set up the parser and the query cursors of the thread */
+  count_allocations(visitor, enabled, huge, files, HUGE);
+
+  small_count = count_allocations(visitor, enabled, small, files, SMALL);
+  large_count = count_allocations(visitor, enabled, large, files, LARGE);
+  huge_count = count_allocations(visitor, enabled, huge, files, HUGE);
+  g_test_message("%d allocations for %d functions, %d for %d, %d for %d",
+                 small_count, SMALL, large_count, LARGE, huge_count, HUGE);
+
+  /* Arrays shared by all functions double, a few more allocations for four
+   * times the functions, so none per function */
+  g_assert_cmpint((large_count - small_count) / (LARGE - SMALL), ==, 0);
+  g_assert_cmpint((huge_count - large_count) / (HUGE - LARGE), ==, 0);
+
+  g_free(small);
+  g_free(large);
+  g_free(huge);
+  g_free(enabled);
+  visitor_free(visitor);
+  g_hash_table_unref(files);
+#else
+  g_test_skip("Allocations are only counted with the GNU C library");
+#endif
+}
+
+/* Resident set size in kB, -1 if unknown */
+static glong
+rss_kb(void)
+{
+  gchar *statm = NULL;
+  glong pages = -1;
+
+  if (!g_file_get_contents("/proc/self/statm", &statm, NULL, NULL)) {
+    return -1;
+  }
+  if (sscanf(statm, "%*s %ld", &pages) != 1) {
+    pages = -1;
+  }
+  g_free(statm);
+
+  return pages < 0 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void
+analyse(const gchar *text, GHashTable *files)
+{
+  parser_t *parser;
+  problems_t *issues;
+
+  parser = parser_for(text, files);
+  parser_parse(parser);
+  issues = rules_helper_run(process_asserts_register, parser);
+  problems_free(issues);
+  parser_unref(parser);
+}
+
+static void
+test_rss(void)
+{
+  GHashTable *files;
+  gchar *text;
+  glong before;
+  glong after;
+
+  if (!g_test_slow()) {
+    g_test_skip("Only run with -m slow");
+    return;
+  }
+  if (rss_kb() < 0) {
+    g_test_skip("No /proc/self/statm");
+    return;
+  }
+
+  files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  text = generate(1);
+
+  for (guint i = 0; i < WARMUP; i++) {
+    analyse(text, files);
+  }
+  before = rss_kb();
+  for (guint i = 0; i < ANALYSES; i++) {
+    analyse(text, files);
+  }
+  after = rss_kb();
+  g_test_message("RSS %ld kB before %d analyses, %ld kB after", before,
+                 ANALYSES, after);
+
+  g_assert_cmpint(after - before, <, MAX_RSS_GROWTH);
+
+  g_free(text);
+  g_hash_table_unref(files);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+#ifdef __GLIBC__
+  /* Keep the nodes of tree-sitter out of the count, they are its own */
+  ts_set_allocator(__libc_malloc, __libc_calloc, __libc_realloc, free);
+#endif
+
+  g_test_add_func("/message/process/assert/alloc/per_function",
+                  test_allocations);
+  g_test_add_func("/message/process/assert/alloc/rss", test_rss);
+
+  return g_test_run();
+}
@@ -4,19 +4,20 @@
 #include "message.h"
 #include "parser.h"
 #include "process_asserts.h"
+#include "rules-helper.h"
 
 struct fixture {
   parser_t *parser;
-  GList *issues;
+  /* Expected problems, as in the json file */
+  JsonArray *issues;
 };
 
-static GList *
+static JsonArray *
 load_issues(const gchar *file)
 {
   JsonParser *parser;
   JsonNode *root;
-  GList *res = NULL;
-  JsonArray *list;
+  JsonArray *res = NULL;
   GError *lerr = NULL;
 
   parser = json_parser_new();
@@ -35,29 +36,7 @@ load_issues(const gchar *file)
     goto out;
   }
 
-  list = json_node_get_array(root);
-
-  for (guint i = 0; i < json_array_get_length(list); i++) {
-    struct problem *p;
-    JsonObject *j;
-    JsonObject *start;
-    JsonObject *end;
-
-    j = json_array_get_object_element(list, i);
-    start = json_object_get_object_member(j, "start");
-    end = json_object_get_object_member(j, "end");
-
-    p = message_problem_new_pos(json_object_get_int_member(j, "prio"),
-                            json_object_get_int_member(start, "line"),
-                            json_object_get_int_member(start, "character"),
-                            json_object_get_int_member(end, "line"),
-                            json_object_get_int_member(end, "character"),
-                            json_object_get_string_member(j, "msg"));
-
-    res = g_list_prepend(res, p);
-  }
-
-  res = g_list_reverse(res);
+  res = json_array_ref(json_node_get_array(root));
   /* Fall through */
 
 out:
@@ -111,47 +90,63 @@ static void
 fixture_teardown(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
 {
   parser_unref(f->parser);
-  g_list_free_full(f->issues, message_problem_free);
+  g_clear_pointer(&f->issues, json_array_unref);
 }
 
 static void
-assert_problem(struct problem *exp, struct problem *act)
+assert_problem(JsonObject *exp,
+               const problems_t *actual,
+               const struct problem *act,
+               GString *msg)
 {
+  JsonObject *start = json_object_get_object_member(exp, "start");
+  JsonObject *end = json_object_get_object_member(exp, "end");
+
   g_assert_true(act != NULL);
-  g_assert_cmpstr(exp->msg, ==, act->msg);
-  g_assert_cmpint(exp->severity, ==, act->severity);
-  g_assert_cmpint(exp->range.start.line, ==, act->range.start.line);
-  g_assert_cmpint(exp->range.start.character, ==, act->range.start.character);
-  g_assert_cmpint(exp->range.end.line, ==, act->range.end.line);
-  g_assert_cmpint(exp->range.end.character, ==, act->range.end.character);
+  g_string_truncate(msg, 0);
+  problems_format(actual, act, msg);
+  g_assert_cmpstr(json_object_get_string_member(exp, "msg"), ==, msg->str);
+  g_assert_cmpint(json_object_get_int_member(exp, "prio"), ==,
+                  rules_get(act->id)->severity);
+  g_assert_cmpint(json_object_get_int_member(start, "line"), ==,
+                  act->start_line);
+  g_assert_cmpint(json_object_get_int_member(start, "character"), ==,
+                  act->start_char);
+  g_assert_cmpint(json_object_get_int_member(end, "line"), ==, act->end_line);
+  g_assert_cmpint(json_object_get_int_member(end, "character"), ==,
+                  act->end_char);
 }
 
 void
 test_assert(struct fixture *f, gconstpointer user_data)
 {
   parser_t *parser = (parser_t *) f;
-  GList *actual;
-  GList *check;
+  problems_t *actual;
+  GString *msg;
+  guint expected;
+  guint n;
 
   g_assert(parser);
 
-  actual = process_asserts(f->parser, NULL);
-  check = actual;
-  for (GList *exp = f->issues; exp != NULL; exp = exp->next) {
-    assert_problem(exp->data, check->data);
-    if (check != NULL) {
-      check = check->next;
-    }
+  actual = rules_helper_run(process_asserts_register, f->parser);
+  msg = g_string_new(NULL);
+  expected = json_array_get_length(f->issues);
+  n = MIN(expected, problems_len(actual));
+  for (guint i = 0; i < n; i++) {
+    assert_problem(json_array_get_object_element(f->issues, i), actual,
+                   problems_get(actual, i), msg);
   }
 
-  if (check != NULL) {
-    struct problem *p;
-    p = check->data;
-    g_warning("Have extra issue that is not supposed to be there: %s", p->msg);
+  for (guint i = n; i < problems_len(actual); i++) {
+    g_string_truncate(msg, 0);
+    problems_format(actual, problems_get(actual, i), msg);
+    g_warning("Have extra issue that is not supposed to be there: %s",
+              msg->str);
   }
-  g_assert_null(check);
+  g_assert_cmpuint(problems_len(actual), ==, expected);
 
-  g_list_free_full(actual, message_problem_free);
+  g_string_free(msg, TRUE);
+  problems_free(actual);
 }
 
 int
@@ -175,6 +170,8 @@ main(int argc, char *argv[])
              fixture_setup, test_assert, fixture_teardown);
   g_test_add("/message/process/assert/commented", struct fixture, "commented",
              fixture_setup, test_assert, fixture_teardown);
+  g_test_add("/message/process/assert/commented_split", struct fixture, "commented_split",
+             fixture_setup, test_assert, fixture_teardown);
   g_test_add("/message/process/assert/gerror", struct fixture, "gerror",
              fixture_setup, test_assert, fixture_teardown);
   g_test_add("/message/process/assert/gerror_ok", struct fixture, "gerror_ok",
@@ -183,6 +180,10 @@ main(int argc, char *argv[])
              fixture_setup, test_assert, fixture_teardown);
   g_test_add("/message/process/assert/explicit_check", struct fixture, "explicit_check",
              fixture_setup, test_assert, fixture_teardown);
+  g_test_add("/message/process/assert/interned", struct fixture, "interned",
+             fixture_setup, test_assert, fixture_teardown);
+  g_test_add("/message/process/assert/forwarded", struct fixture, "forwarded",
+             fixture_setup, test_assert, fixture_teardown);
 
   return g_test_run();
 }
@@ -0,0 +1,232 @@
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "message.h"
+#include "parser.h"
+#include "process_queries.h"
+#include "rules-helper.h"
+
+struct fixture {
+  parser_t *parser;
+  /* Expected problems, as in the json file */
+  JsonArray *issues;
+};
+
+static JsonArray *
+load_issues(const gchar *file)
+{
+  JsonParser *parser;
+  JsonNode *root;
+  JsonArray *res = NULL;
+  GError *lerr = NULL;
+
+  parser = json_parser_new();
+
+  if (!json_parser_load_from_file(parser, file, &lerr)) {
+    g_warning("Unable to load issues file: %s",
+              lerr ? lerr->message : "No error message");
+    g_clear_error(&lerr);
+    g_clear_object(&parser);
+    return NULL;
+  }
+
+  root = json_parser_get_root(parser);
+
+  if (!JSON_NODE_HOLDS_ARRAY(root)) {
+    goto out;
+  }
+
+  res = json_array_ref(json_node_get_array(root));
+  /* Fall through */
+
+out:
+  g_object_unref(parser);
+
+  return res;
+}
+
+/* Rules can only be loaded once, the first test to need them does */
+static void
+load_rules(const gchar *name)
+{
+  GError *lerr = NULL;
+  gchar *rulesfile;
+
+  if (process_queries_count() > 0) {
+    return;
+  }
+  rulesfile = g_strdup_printf("%s/queries/%s.json", g_getenv("G_TEST_SRCDIR"),
+                              name);
+  g_assert_true(process_queries_load(rulesfile, &lerr));
+  g_assert_no_error(lerr);
+  g_free(rulesfile);
+}
+
+static void
+fixture_setup(struct fixture *f, gconstpointer user_data)
+{
+  gchar *name = (gchar *) user_data;
+  message_t *msg;
+  GHashTable *ht;
+  gchar *content = NULL;
+  gchar *codefile;
+  gchar *issuesfile;
+  GError *lerr = NULL;
+
+  g_assert(f);
+  g_assert(name);
+
+  g_message("Setting up test %s", name);
+  load_rules("rules");
+  codefile = g_strdup_printf("%s/queries/%s.c", g_getenv("G_TEST_SRCDIR"),
+                             name);
+  issuesfile = g_strdup_printf("%s/queries/%s.json", g_getenv("G_TEST_SRCDIR"),
+                               name);
+
+  if (!g_file_get_contents(codefile, &content, NULL, &lerr)) {
+    g_warning("Failed to load test file: %s",
+              lerr ? lerr->message : "No error msg");
+    g_clear_error(&lerr);
+    return;
+  }
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_OPEN;
+  msg->data.open.uri = g_strdup(codefile);
+  msg->data.open.text = content;
+  msg->data.open.version = 1;
+  msg->data.open.language = g_strdup("c");
+
+  ht = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  f->parser = parser_new(msg, ht);
+  f->issues = load_issues(issuesfile);
+  g_free(codefile);
+  g_free(issuesfile);
+}
+
+static void
+fixture_teardown(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  parser_unref(f->parser);
+  g_clear_pointer(&f->issues, json_array_unref);
+}
+
+static void
+assert_problem(JsonObject *exp,
+               const problems_t *actual,
+               const struct problem *act,
+               GString *msg)
+{
+  JsonObject *start = json_object_get_object_member(exp, "start");
+  JsonObject *end = json_object_get_object_member(exp, "end");
+
+  g_assert_true(act != NULL);
+  g_string_truncate(msg, 0);
+  problems_format(actual, act, msg);
+  g_assert_cmpstr(json_object_get_string_member(exp, "msg"), ==, msg->str);
+  g_assert_cmpstr(json_object_get_string_member(exp, "code"), ==,
+                  rules_get(act->id)->code);
+  g_assert_cmpint(json_object_get_int_member(exp, "prio"), ==,
+                  rules_get(act->id)->severity);
+  g_assert_cmpint(json_object_get_int_member(start, "line"), ==,
+                  act->start_line);
+  g_assert_cmpint(json_object_get_int_member(start, "character"), ==,
+                  act->start_char);
+  g_assert_cmpint(json_object_get_int_member(end, "line"), ==, act->end_line);
+  g_assert_cmpint(json_object_get_int_member(end, "character"), ==,
+                  act->end_char);
+}
+
+void
+test_invalid(void)
+{
+  GError *lerr = NULL;
+  gchar *rulesfile;
+
+  rulesfile = g_strdup_printf("%s/queries/invalid.json",
+                              g_getenv("G_TEST_SRCDIR"));
+  g_assert_false(process_queries_load(rulesfile, &lerr));
+  g_assert_error(lerr, VISITOR_ERROR, -1);
+  g_message("Rejected: %s", lerr->message);
+  /* Not even the valid rule of the file is kept */
+  g_assert_cmpuint(process_queries_count(), ==, 0);
+  g_assert_cmpuint(rules_count(), ==, RULE_COUNT);
+
+  g_clear_error(&lerr);
+  g_free(rulesfile);
+}
+
+/* The client is told why the rules were not loaded once it is initialized */
+void
+test_invalid_notice(void)
+{
+  GHashTable *files;
+  message_t *msg;
+  parser_t *parser;
+  GList *notices;
+
+  files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_INITIALIZED;
+  parser = parser_new_deferred(msg, files);
+
+  notices = process_queries_notices(parser, NULL);
+  g_assert_cmpuint(g_list_length(notices), ==, 1);
+  g_assert_nonnull(strstr(notices->data, "window/showMessage"));
+  g_assert_nonnull(strstr(notices->data, "invalid.json"));
+
+  g_list_free_full(notices, g_free);
+  parser_unref(parser);
+  g_hash_table_unref(files);
+}
+
+void
+test_queries(struct fixture *f, gconstpointer user_data)
+{
+  parser_t *parser = (parser_t *) f;
+  problems_t *actual;
+  GString *msg;
+  guint expected;
+  guint n;
+
+  g_assert(parser);
+
+  actual = rules_helper_run(process_queries_register, f->parser);
+  msg = g_string_new(NULL);
+  expected = json_array_get_length(f->issues);
+  n = MIN(expected, problems_len(actual));
+  for (guint i = 0; i < n; i++) {
+    assert_problem(json_array_get_object_element(f->issues, i), actual,
+                   problems_get(actual, i), msg);
+  }
+
+  for (guint i = n; i < problems_len(actual); i++) {
+    g_string_truncate(msg, 0);
+    problems_format(actual, problems_get(actual, i), msg);
+    g_warning("Have extra issue that is not supposed to be there: %s",
+              msg->str);
+  }
+  g_assert_cmpuint(problems_len(actual), ==, expected);
+
+  g_string_free(msg, TRUE);
+  problems_free(actual);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  // Define the tests.
+
+  /* Before any test loads the valid rules */
+  g_test_add_func("/message/process/queries/invalid", test_invalid);
+  g_test_add_func("/message/process/queries/invalid/notice",
+                  test_invalid_notice);
+  g_test_add("/message/process/queries/calls", struct fixture, "calls",
+             fixture_setup, test_queries, fixture_teardown);
+
+  return g_test_run();
+}
@@ -0,0 +1,808 @@
+#include <gio/gio.h>
+#include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "message.h"
+#include "process_asserts.h"
+#include "process_midscope.h"
+#include "processor.h"
+
+/* Diagnostics are only published when the client does not have them yet,
+ * and those of an incremental analysis are those of a full one */
+
+/* Longest wait for an analysis to be published */
+#define TIMEOUT (10 * G_TIME_SPAN_SECOND)
+
+#define CONTENT_LEN "Content-Length: "
+
+/* Files the slow rule holds up, it takes this long on each function of
+ * them, well over the budget of cheap rules */
+#define SLOW_PREFIX "file:///slow-"
+#define SLOW_SLEEP (100 * G_TIME_SPAN_MILLISECOND)
+
+/* As in processor.c: overruns in a row before a rule is disabled for a
+ * document, and the share (1/n) of it to edit before the rule runs again */
+#define BUDGET_STRIKES 3
+#define BUDGET_REARM_SHARE 4
+
+/* One declaration after a statement */
+#define TEXT \
+  "void\n" \
+  "f(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "  gint late;\n" \
+  "}\n"
+
+/* A parameter that is not asserted, found by the expensive rules */
+#define ASSERT_TEXT \
+  "static gint\n" \
+  "g(gchar *str)\n" \
+  "{\n" \
+  "  return strlen(str);\n" \
+  "}\n"
+
+/* Functions with a declaration after a statement, small enough for an edit
+ * of one of them to be analyzed incrementally */
+#define SHIFT_TEXT \
+  "void\n" \
+  "a(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "}\n" \
+  "\n" \
+  "void\n" \
+  "b(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "  gint middle;\n" \
+  "}\n" \
+  "\n" \
+  "void\n" \
+  "c(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "}\n" \
+  "\n" \
+  "void\n" \
+  "d(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "}\n" \
+  "\n" \
+  "void\n" \
+  "e(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "  gint last;\n" \
+  "}\n" \
+  "\n" \
+  "void\n" \
+  "f(void)\n" \
+  "{\n" \
+  "  call();\n" \
+  "}\n"
+
+/* An edit of SHIFT_TEXT, replacing the first occurrence of from with to */
+struct shift_case {
+  const gchar *from;
+  const gchar *to;
+  /* Whether the problems the client has change */
+  gboolean publish;
+};
+
+static processor_t *processor = NULL;
+
+/* Functions the slow rule started on */
+static gint slow_visits = 0;
+
+/* JsonObject of every message the client was sent, in order */
+static GPtrArray *sent = NULL;
+static GMutex sent_lock;
+
+/* Reads the messages of the processor like a client */
+static gpointer
+client(gpointer data)
+{
+  GDataInputStream *in = (GDataInputStream *) data;
+  GError *lerr = NULL;
+
+  g_assert(data);
+
+  while (TRUE) {
+    gsize content_len = 0;
+    gchar *line;
+    gchar *json;
+    JsonNode *node;
+
+    while (content_len == 0) {
+      line = g_data_input_stream_read_line_utf8(in, NULL, NULL, &lerr);
+      g_assert_no_error(lerr);
+      g_assert_nonnull(line);
+      if (g_str_has_prefix(line, CONTENT_LEN)) {
+        content_len = atoi(line + strlen(CONTENT_LEN));
+      }
+      g_free(line);
+    }
+    /* The empty line after the header */
+    g_free(g_data_input_stream_read_line_utf8(in, NULL, NULL, &lerr));
+    g_assert_no_error(lerr);
+
+    json = g_malloc0(content_len + 1);
+    g_assert_true(g_input_stream_read_all(G_INPUT_STREAM(in), json,
+                                          content_len, NULL, NULL, &lerr));
+    g_assert_no_error(lerr);
+    node = json_from_string(json, &lerr);
+    g_assert_no_error(lerr);
+    g_free(json);
+
+    g_mutex_lock(&sent_lock);
+    g_ptr_array_add(sent, json_object_ref(json_node_get_object(node)));
+    g_mutex_unlock(&sent_lock);
+    json_node_unref(node);
+  }
+
+  return NULL;
+}
+
+typedef gboolean (*match_func_t)(JsonObject *msg, gconstpointer data);
+
+/* A publishDiagnostics notification, of the file data unless it is NULL */
+static gboolean
+is_publish(JsonObject *msg, gconstpointer data)
+{
+  JsonObject *params;
+
+  if (!json_object_has_member(msg, "method") ||
+      g_strcmp0(json_object_get_string_member(msg, "method"),
+                "textDocument/publishDiagnostics") != 0) {
+    return FALSE;
+  }
+  params = json_object_get_object_member(msg, "params");
+  return data == NULL ||
+         g_strcmp0(json_object_get_string_member(params, "uri"), data) == 0;
+}
+
+/* The answer to the request whose id data points to */
+static gboolean
+is_answer(JsonObject *msg, gconstpointer data)
+{
+  return json_object_has_member(msg, "id") &&
+         json_object_get_int_member(msg, "id") == *(const gint64 *) data;
+}
+
+/* A showMessage notification whose text holds data */
+static gboolean
+is_shown(JsonObject *msg, gconstpointer data)
+{
+  JsonObject *params;
+
+  if (!json_object_has_member(msg, "method") ||
+      g_strcmp0(json_object_get_string_member(msg, "method"),
+                "window/showMessage") != 0) {
+    return FALSE;
+  }
+  params = json_object_get_object_member(msg, "params");
+  return strstr(json_object_get_string_member(params, "message"), data) !=
+         NULL;
+}
+
+/* Messages sent so far matching match, a reference to the last one is
+ * taken if last is not NULL */
+static guint
+count_sent(match_func_t match, gconstpointer data, JsonObject **last)
+{
+  guint found = 0;
+
+  g_mutex_lock(&sent_lock);
+  for (guint i = 0; i < sent->len; i++) {
+    JsonObject *msg = g_ptr_array_index(sent, i);
+
+    if (match(msg, data)) {
+      found++;
+      if (last != NULL) {
+        g_clear_pointer(last, json_object_unref);
+        *last = json_object_ref(msg);
+      }
+    }
+  }
+  g_mutex_unlock(&sent_lock);
+
+  return found;
+}
+
+/* Waits for count messages matching match to be sent, and takes a
+ * reference to the last */
+static JsonObject *
+wait_sent(match_func_t match, gconstpointer data, guint count)
+{
+  JsonObject *last = NULL;
+  guint found;
+  gint64 deadline = g_get_monotonic_time() + TIMEOUT;
+
+  while ((found = count_sent(match, data, &last)) < count &&
+         g_get_monotonic_time() < deadline) {
+    g_usleep(1000);
+  }
+
+  g_assert_cmpuint(found, >=, count);
+  return last;
+}
+
+static gchar *
+array_text(JsonArray *array)
+{
+  JsonNode *node = json_node_new(JSON_NODE_ARRAY);
+  gchar *res;
+
+  json_node_set_array(node, array);
+  res = json_to_string(node, FALSE);
+  json_node_unref(node);
+
+  return res;
+}
+
+/* The diagnostics the client has for uri, once it was sent every
+ * notification published so far */
+static gchar *
+published(const gchar *uri)
+{
+  struct processor_stats stats;
+  JsonObject *msg;
+  gchar *res;
+
+  processor_get_stats(processor, &stats);
+  msg = wait_sent(is_publish, NULL, stats.publishes);
+  g_clear_pointer(&msg, json_object_unref);
+
+  msg = wait_sent(is_publish, uri, 1);
+  res = array_text(json_object_get_array_member(
+    json_object_get_object_member(msg, "params"), "diagnostics"));
+  json_object_unref(msg);
+
+  return res;
+}
+
+/* The diagnostics of the answer to request id */
+static gchar *
+answered(gint64 id)
+{
+  JsonObject *msg;
+  gchar *res;
+
+  msg = wait_sent(is_answer, &id, 1);
+  g_assert_true(json_object_has_member(msg, "items"));
+  res = array_text(json_object_get_array_member(msg, "items"));
+  json_object_unref(msg);
+
+  return res;
+}
+
+static void
+match_slow(struct visit_ctx *v,
+           G_GNUC_UNUSED const TSNode *captures,
+           G_GNUC_UNUSED gpointer user_data)
+{
+  g_assert(v);
+
+  if (g_str_has_prefix(v->parser->file, SLOW_PREFIX)) {
+    g_atomic_int_inc(&slow_visits);
+    g_usleep(SLOW_SLEEP);
+  }
+}
+
+static const gchar *const slow_captures[] = {"function", NULL};
+
+static void
+slow_register(visitor_t *visitor, guint rule)
+{
+  g_assert(visitor);
+
+  visitor_add_query(visitor, rule, "(function_definition) @function",
+                    slow_captures, match_slow, NULL);
+}
+
+/* A function for the slow rule to work on, different in every version so
+ * that no problems are reused */
+static gchar *
+slow_text(gint64 version)
+{
+  return g_strdup_printf("void\n"
+                         "slow(void)\n"
+                         "{\n"
+                         "  /* Version %ld */\n"
+                         "}\n",
+                         version);
+}
+
+/* Waits for the slow rule to start on a function, it had started on visits
+ * before */
+static void
+wait_slow(gint visits)
+{
+  gint64 deadline = g_get_monotonic_time() + TIMEOUT;
+
+  while (g_atomic_int_get(&slow_visits) == visits &&
+         g_get_monotonic_time() < deadline) {
+    g_usleep(1000);
+  }
+  g_assert_cmpint(g_atomic_int_get(&slow_visits), >, visits);
+}
+
+static void
+send_document(enum message_type type,
+              const gchar *uri,
+              gint64 version,
+              const gchar *text)
+{
+  message_t *msg;
+  GError *lerr = NULL;
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = type;
+  msg->data.change.uri = g_strdup(uri);
+  msg->data.change.text = g_strdup(text);
+  msg->data.change.version = version;
+  msg->data.change.language = g_strdup("c");
+
+  g_assert_true(processor_handle_message(processor, msg, &lerr));
+  g_assert_no_error(lerr);
+}
+
+/* Pulls the diagnostics of uri, returns the id of the request */
+static gint64
+send_request(const gchar *uri)
+{
+  static gint64 ids = 0;
+  message_t *msg;
+  GError *lerr = NULL;
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_DIAGNOSTIC;
+  msg->data.diagnostic.id = ++ids;
+  msg->data.diagnostic.document.uri = g_strdup(uri);
+
+  g_assert_true(processor_handle_message(processor, msg, &lerr));
+  g_assert_no_error(lerr);
+
+  return ids;
+}
+
+/* Waits for the analysis sent last to publish or be suppressed, before
+ * stats counted publishes and suppressed. Analyses are waited for one at a
+ * time, a newer version would cancel the one running. */
+static void
+wait_published(const struct processor_stats *before,
+               guint64 publishes,
+               guint64 suppressed)
+{
+  struct processor_stats stats;
+  gint64 deadline = g_get_monotonic_time() + TIMEOUT;
+
+  do {
+    processor_get_stats(processor, &stats);
+    if (stats.publishes + stats.publishes_suppressed >
+        before->publishes + before->publishes_suppressed) {
+      break;
+    }
+    g_usleep(1000);
+  } while (g_get_monotonic_time() < deadline);
+
+  g_assert_cmpuint(stats.publishes - before->publishes, ==, publishes);
+  g_assert_cmpuint(stats.publishes_suppressed - before->publishes_suppressed,
+                   ==, suppressed);
+}
+
+/* Saves an unchanged uri, so that no idle analysis of it is published
+ * during a later test */
+static void
+settle(const gchar *uri)
+{
+  struct processor_stats before;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_SAVE, uri, 0, NULL);
+  wait_published(&before, 0, 1);
+}
+
+/* The diagnostics of a full analysis of text, in a file of its own */
+static gchar *
+full_analysis(const gchar *text)
+{
+  static guint files = 0;
+  struct processor_stats before;
+  gchar *uri;
+  gchar *res;
+
+  uri = g_strdup_printf("file:///full-%u.c", files++);
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, text);
+  wait_published(&before, 1, 0);
+  res = published(uri);
+  g_free(uri);
+
+  return res;
+}
+
+static void
+test_unchanged(void)
+{
+  const gchar *uri = "file:///unchanged.c";
+  struct processor_stats before;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, TEXT);
+  wait_published(&before, 1, 0);
+
+  /* Text after the problem, which stays where it is */
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 2, TEXT "\n/* More */\n");
+  wait_published(&before, 0, 1);
+
+  settle(uri);
+}
+
+static void
+test_moved(void)
+{
+  const gchar *uri = "file:///moved.c";
+  struct processor_stats before;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, TEXT);
+  wait_published(&before, 1, 0);
+
+  /* The same problem a line further down */
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 2, "\n" TEXT);
+  wait_published(&before, 1, 0);
+
+  settle(uri);
+}
+
+static void
+test_reopened(void)
+{
+  const gchar *uri = "file:///reopened.c";
+  struct processor_stats before;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 3, TEXT);
+  wait_published(&before, 1, 0);
+
+  /* The client has nothing for a file it opened again */
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, TEXT);
+  wait_published(&before, 1, 0);
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 2, TEXT);
+  wait_published(&before, 0, 1);
+
+  settle(uri);
+}
+
+/* The problems kept from the last analysis are moved past the edit, and the
+ * client ends up with what a full analysis finds */
+static void
+test_shift(gconstpointer data)
+{
+  const struct shift_case *c = (const struct shift_case *) data;
+  static guint files = 0;
+  struct processor_stats before;
+  struct processor_stats stats;
+  const gchar *at;
+  GString *text;
+  gchar *uri;
+  gchar *incremental;
+  gchar *full;
+
+  at = strstr(SHIFT_TEXT, c->from);
+  g_assert_nonnull(at);
+  text = g_string_new_len(SHIFT_TEXT, at - SHIFT_TEXT);
+  g_string_append(text, c->to);
+  g_string_append(text, at + strlen(c->from));
+
+  uri = g_strdup_printf("file:///shift-%u.c", files++);
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, SHIFT_TEXT);
+  wait_published(&before, 1, 0);
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 2, text->str);
+  wait_published(&before, c->publish, !c->publish);
+  processor_get_stats(processor, &stats);
+  g_assert_cmpuint(stats.incremental - before.incremental, ==, 1);
+
+  incremental = published(uri);
+  full = full_analysis(text->str);
+  g_assert_cmpstr(incremental, ==, full);
+
+  settle(uri);
+
+  g_free(incremental);
+  g_free(full);
+  g_free(uri);
+  g_string_free(text, TRUE);
+}
+
+static const struct shift_case shift_above = {
+  "  call();\n}\n\nvoid\nb", "  call();\n  call();\n}\n\nvoid\nb", TRUE,
+};
+
+static const struct shift_case shift_inside = {
+  "gint middle;", "gint middle_renamed;", TRUE,
+};
+
+static const struct shift_case shift_below = {
+  "f(void)\n{\n  call();", "f(void)\n{\n  called();", FALSE,
+};
+
+static const struct shift_case shift_insert_lines = {
+  "\nvoid\nb(void)",
+  "\nvoid\nadded(void)\n{\n  call();\n  gint added;\n}\n\nvoid\nb(void)",
+  TRUE,
+};
+
+static const struct shift_case shift_delete_lines = {
+  "void\na(void)\n{\n  call();\n}\n\n", "", TRUE,
+};
+
+/* A request for a version that was analyzed is answered from the store */
+static void
+test_request_stored(void)
+{
+  const gchar *uri = "file:///stored.c";
+  struct processor_stats before;
+  struct processor_stats stats;
+  gchar *answer;
+  gchar *diagnostics;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, TEXT);
+  wait_published(&before, 1, 0);
+
+  processor_get_stats(processor, &before);
+  answer = answered(send_request(uri));
+  processor_get_stats(processor, &stats);
+
+  g_assert_cmpuint(stats.results.hits - before.results.hits, ==,
+                   PROCESS_TIER_COUNT);
+  g_assert_cmpuint(stats.results.computed, ==, before.results.computed);
+  diagnostics = published(uri);
+  g_assert_cmpstr(answer, ==, diagnostics);
+
+  g_free(answer);
+  g_free(diagnostics);
+}
+
+/* A request for a version being analyzed waits for that analysis */
+static void
+test_request_running(void)
+{
+  const gchar *uri = SLOW_PREFIX "running.c";
+  struct processor_stats before;
+  struct processor_stats stats;
+  gint visits = g_atomic_int_get(&slow_visits);
+  gchar *text = slow_text(1);
+  gchar *answer;
+  gchar *diagnostics;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, text);
+  wait_slow(visits);
+  answer = answered(send_request(uri));
+  wait_published(&before, 1, 0);
+  processor_get_stats(processor, &stats);
+
+  /* Every tier ran once, for the notification or for the request */
+  g_assert_cmpuint(stats.results.computed - before.results.computed, ==,
+                   PROCESS_TIER_COUNT);
+  g_assert_cmpuint(stats.results.waits - before.results.waits, >=, 1);
+  g_assert_cmpuint(stats.results.duplicates, ==, before.results.duplicates);
+  diagnostics = published(uri);
+  g_assert_cmpstr(answer, ==, diagnostics);
+
+  g_free(text);
+  g_free(answer);
+  g_free(diagnostics);
+}
+
+/* A newer version cancels the analysis of the one before */
+static void
+test_cancelled(void)
+{
+  const gchar *uri = SLOW_PREFIX "cancelled.c";
+  struct processor_stats before;
+  struct processor_stats stats;
+  gint64 deadline;
+  gint visits;
+  gchar *text;
+
+  text = slow_text(1);
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, text);
+  wait_published(&before, 1, 0);
+  g_free(text);
+
+  processor_get_stats(processor, &before);
+  visits = g_atomic_int_get(&slow_visits);
+  text = slow_text(2);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 2, text);
+  g_free(text);
+  wait_slow(visits);
+
+  /* While the slow rule is on version 2 */
+  text = slow_text(3);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 3, text);
+  g_free(text);
+  wait_published(&before, 0, 1);
+
+  deadline = g_get_monotonic_time() + TIMEOUT;
+  do {
+    processor_get_stats(processor, &stats);
+    if (stats.cancelled > before.cancelled) {
+      break;
+    }
+    g_usleep(1000);
+  } while (g_get_monotonic_time() < deadline);
+
+  g_assert_cmpuint(stats.cancelled - before.cancelled, ==, 1);
+  g_assert_cmpuint(stats.analyses - before.analyses, ==, 1);
+
+  settle(uri);
+}
+
+/* A change only runs the cheap rules, the save that follows adds what the
+ * expensive ones find */
+static void
+test_saved(void)
+{
+  const gchar *uri = "file:///saved.c";
+  struct processor_stats before;
+  gchar *changed;
+  gchar *saved;
+  gchar *full;
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_OPEN, uri, 1, TEXT);
+  wait_published(&before, 1, 0);
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, 2, TEXT "\n" ASSERT_TEXT);
+  wait_published(&before, 0, 1);
+  changed = published(uri);
+  g_assert_nonnull(strstr(changed, "midscope.declaration"));
+  g_assert_null(strstr(changed, "asserts.param"));
+
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_SAVE, uri, 0, NULL);
+  wait_published(&before, 1, 0);
+  saved = published(uri);
+  g_assert_nonnull(strstr(saved, "midscope.declaration"));
+  g_assert_nonnull(strstr(saved, "asserts.param"));
+
+  full = full_analysis(TEXT "\n" ASSERT_TEXT);
+  g_assert_cmpstr(saved, ==, full);
+
+  g_free(changed);
+  g_free(saved);
+  g_free(full);
+}
+
+/* A rule that keeps taking too long is disabled for the document, and runs
+ * again once enough of it was edited */
+static void
+test_budget(void)
+{
+  const gchar *uri = SLOW_PREFIX "budget.c";
+  struct processor_stats before;
+  JsonObject *notice;
+  gchar *diagnostics;
+  gchar *padding;
+  gchar *function;
+  gchar *text;
+  gint visits;
+  gint64 version;
+
+  for (version = 1; version <= BUDGET_STRIKES; version++) {
+    g_assert_cmpuint(count_sent(is_shown, uri, NULL), ==, 0);
+    text = slow_text(version);
+    processor_get_stats(processor, &before);
+    send_document(version == 1 ? MESSAGE_TYPE_OPEN : MESSAGE_TYPE_CHANGE, uri,
+                  version, text);
+    wait_published(&before, version == 1, version != 1);
+    g_free(text);
+  }
+
+  /* Told once, not as a diagnostic */
+  notice = wait_sent(is_shown, uri, 1);
+  g_assert_nonnull(strstr(json_object_get_string_member(
+                            json_object_get_object_member(notice, "params"),
+                            "message"),
+                          "slow"));
+  json_object_unref(notice);
+  diagnostics = published(uri);
+  g_assert_null(strstr(diagnostics, "disabled"));
+  g_free(diagnostics);
+
+  /* A small edit leaves it disabled */
+  visits = g_atomic_int_get(&slow_visits);
+  text = slow_text(version);
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, version++, text);
+  wait_published(&before, 0, 1);
+  g_assert_cmpint(g_atomic_int_get(&slow_visits), ==, visits);
+
+  /* Adding a share of the document it was disabled on re-enables it */
+  padding = g_strnfill(strlen(text) / BUDGET_REARM_SHARE + 1, '-');
+  g_free(text);
+  function = slow_text(version);
+  text = g_strdup_printf("/* %s */\n%s", padding, function);
+  g_free(function);
+  processor_get_stats(processor, &before);
+  send_document(MESSAGE_TYPE_CHANGE, uri, version++, text);
+  wait_published(&before, 0, 1);
+  g_assert_cmpint(g_atomic_int_get(&slow_visits), >, visits);
+  g_assert_cmpuint(count_sent(is_shown, uri, NULL), ==, 1);
+
+  settle(uri);
+
+  g_free(padding);
+  g_free(text);
+}
+
+int
+main(int argc, char *argv[])
+{
+  message_t *init;
+  GDataInputStream *in;
+  gint fds[2];
+  GError *lerr = NULL;
+
+  g_test_init(&argc, &argv, NULL);
+
+  g_assert_true(g_unix_open_pipe(fds, FD_CLOEXEC, &lerr));
+  g_assert_no_error(lerr);
+  sent = g_ptr_array_new_with_free_func((GDestroyNotify) json_object_unref);
+  in = g_data_input_stream_new(g_unix_input_stream_new(fds[0], TRUE));
+  g_thread_new("client", client, in);
+
+  processor = processor_new(g_unix_output_stream_new(fds[1], TRUE));
+  processor_add_rule(processor, "midscope", process_midscope_register,
+                     PROCESS_TIER_CHEAP);
+  processor_add_rule(processor, "slow", slow_register, PROCESS_TIER_CHEAP);
+  processor_add_rule(processor, "asserts", process_asserts_register,
+                     PROCESS_TIER_EXPENSIVE);
+  g_assert_true(processor_compile(processor, NULL));
+
+  /* A request runs beside a slow analysis even on a single CPU */
+  init = g_malloc0(sizeof(*init));
+  init->type = MESSAGE_TYPE_INITIALIZE;
+  init->data.init.min_workers = 2;
+  g_assert_true(processor_handle_message(processor, init, &lerr));
+  g_assert_no_error(lerr);
+
+  g_test_add_func("/processor/publish/unchanged", test_unchanged);
+  g_test_add_func("/processor/publish/moved", test_moved);
+  g_test_add_func("/processor/publish/reopened", test_reopened);
+  g_test_add_data_func("/processor/shift/above", &shift_above, test_shift);
+  g_test_add_data_func("/processor/shift/inside", &shift_inside, test_shift);
+  g_test_add_data_func("/processor/shift/below", &shift_below, test_shift);
+  g_test_add_data_func("/processor/shift/insert_lines", &shift_insert_lines,
+                       test_shift);
+  g_test_add_data_func("/processor/shift/delete_lines", &shift_delete_lines,
+                       test_shift);
+  g_test_add_func("/processor/request/stored", test_request_stored);
+  g_test_add_func("/processor/request/running", test_request_running);
+  g_test_add_func("/processor/cancel/newer", test_cancelled);
+  g_test_add_func("/processor/tier/saved", test_saved);
+  g_test_add_func("/processor/budget/disabled", test_budget);
+
+  return g_test_run();
+}
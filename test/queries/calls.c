@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include <string.h>
+
+void
+copy(char *dst, const char *src)
+{
+  strcpy(dst, src);
+  strncpy(dst, src, 4);
+}
+
+void
+print(int a)
+{
+  printf("value %d\n", a);
+  puts("ERROR: out of range");
+  fprintf(stderr, "value\n");
+  a = a;
+}
@@ -0,0 +1,73 @@
+#include <glib.h>
+
+#include "process_asserts.h"
+#include "process_comments.h"
+#include "process_midscope.h"
+#include "process_queries.h"
+#include "rules-helper.h"
+
+#define CACHE_ENTRIES 1024
+
+/* In the order main.c adds them */
+static const visitor_register_func_t rules[] = {
+  process_asserts_register,
+  process_midscope_register,
+  process_comments_register,
+  process_queries_register,
+};
+
+/* Built on first use, after the tests loaded the rules of the user */
+static visitor_t *visitor = NULL;
+
+visitor_t *
+rules_helper_visitor_new(function_cache_t *cache)
+{
+  visitor_t *res = visitor_new();
+
+  for (guint i = 0; i < G_N_ELEMENTS(rules); i++) {
+    rules[i](res, i);
+  }
+  if (cache != NULL) {
+    visitor_set_cache(res, cache);
+  }
+  g_assert_true(visitor_compile(res));
+
+  return res;
+}
+
+gboolean *
+rules_helper_enabled(visitor_register_func_t reg)
+{
+  gboolean *res = g_new0(gboolean, G_N_ELEMENTS(rules));
+  guint rule = 0;
+
+  g_assert(reg);
+
+  while (rule < G_N_ELEMENTS(rules) && rules[rule] != reg) {
+    rule++;
+  }
+  g_assert_cmpuint(rule, <, G_N_ELEMENTS(rules));
+  res[rule] = TRUE;
+
+  return res;
+}
+
+problems_t *
+rules_helper_run(visitor_register_func_t reg, parser_t *parser)
+{
+  gboolean *enabled;
+  problems_t *res = problems_new();
+
+  g_assert(reg);
+  g_assert(parser);
+
+  if (visitor == NULL) {
+    visitor = rules_helper_visitor_new(function_cache_new(CACHE_ENTRIES));
+  }
+  enabled = rules_helper_enabled(reg);
+  visitor_run(visitor, parser, enabled, NULL, res);
+  problems_sort(res);
+  g_free(enabled);
+
+  return res;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glib.h>
+
+#include "function_cache.h"
+#include "parser.h"
+#include "problems.h"
+#include "visitor.h"
+
+/* Problems of the rule registered by reg over parser, sorted. The rule runs
+ * in a visitor composed like the one of the server: registered among all the
+ * built in rules and the loaded rules of the user, sharing their query pass,
+ * with a function cache. */
+problems_t *rules_helper_run(visitor_register_func_t reg, parser_t *parser);
+
+/* A compiled visitor composed like the one of the server, reusing problems
+ * from cache unless it is NULL */
+visitor_t *rules_helper_visitor_new(function_cache_t *cache);
+
+/* The enabled argument of visitor_run() for the visitors of the helper that
+ * only runs the rule registered by reg, free with g_free() */
+gboolean *rules_helper_enabled(visitor_register_func_t reg);
@@ -0,0 +1,217 @@
+#include <glib.h>
+
+#include "message.h"
+#include "parser.h"
+#include "process_asserts.h"
+#include "rules-helper.h"
+#include "summary_store.h"
+
+/* A caller in one document relies on what a function of another document
+ * asserts, for as long as that document still defines it */
+
+#define CALLEE_URI "file:///callee.c"
+#define OTHER_URI  "file:///other.c"
+#define CALLER_URI "file:///caller.c"
+
+#define CALLER \
+  "static gint\n" \
+  "forwards(gchar *text)\n" \
+  "{\n" \
+  "  return checked(text);\n" \
+  "}\n"
+
+#define CHECKED \
+  "gint\n" \
+  "checked(gchar *str)\n" \
+  "{\n" \
+  "  g_assert(str);\n" \
+  "  return 0;\n" \
+  "}\n"
+
+#define UNCHECKED \
+  "gint\n" \
+  "checked(gchar *str)\n" \
+  "{\n" \
+  "  return 0;\n" \
+  "}\n"
+
+#define RENAMED \
+  "gint\n" \
+  "validated(gchar *str)\n" \
+  "{\n" \
+  "  g_assert(str);\n" \
+  "  return 0;\n" \
+  "}\n"
+
+#define MADE_STATIC \
+  "static gint\n" \
+  "checked(gchar *str)\n" \
+  "{\n" \
+  "  g_assert(str);\n" \
+  "  return 0;\n" \
+  "}\n"
+
+struct fixture {
+  GHashTable *files;
+  summary_store_t *store;
+};
+
+static void
+fixture_set_up(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  f->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  f->store = summary_store_new();
+}
+
+static void
+fixture_tear_down(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  summary_store_free(f->store);
+  g_hash_table_unref(f->files);
+}
+
+static parser_t *
+open_document(struct fixture *f,
+              const gchar *uri,
+              gint64 version,
+              const gchar *text)
+{
+  message_t *msg;
+  parser_t *parser;
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_OPEN;
+  msg->data.open.uri = g_strdup(uri);
+  msg->data.open.text = g_strdup(text);
+  msg->data.open.version = version;
+  msg->data.open.language = g_strdup("c");
+
+  parser = parser_new(msg, f->files);
+  parser->summaries = f->store;
+  return parser;
+}
+
+/* Analyzes version of uri, which publishes what it defines */
+static void
+publish(struct fixture *f, const gchar *uri, gint64 version, const gchar *text)
+{
+  parser_t *parser = open_document(f, uri, version, text);
+
+  parser_get_functions(parser);
+  parser_unref(parser);
+}
+
+/* Problems of the asserts rule in the caller */
+static guint
+caller_problems(struct fixture *f)
+{
+  parser_t *parser = open_document(f, CALLER_URI, 1, CALLER);
+  problems_t *problems;
+  guint n;
+
+  problems = rules_helper_run(process_asserts_register, parser);
+  n = problems_len(problems);
+  problems_free(problems);
+  parser_unref(parser);
+
+  return n;
+}
+
+static void
+test_removed(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  guint64 asserted;
+
+  publish(f, CALLEE_URI, 1, CHECKED);
+  g_assert_cmpuint(caller_problems(f), ==, 0);
+
+  publish(f, CALLEE_URI, 2, "gint\nother(void)\n{\n  return 0;\n}\n");
+  g_assert_false(summary_store_lookup(f->store, "checked", &asserted));
+  g_assert_cmpuint(caller_problems(f), ==, 1);
+}
+
+static void
+test_renamed(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  guint64 asserted;
+
+  publish(f, CALLEE_URI, 1, CHECKED);
+  publish(f, CALLEE_URI, 2, RENAMED);
+  g_assert_false(summary_store_lookup(f->store, "checked", &asserted));
+  g_assert_true(summary_store_lookup(f->store, "validated", &asserted));
+  g_assert_cmpuint(asserted, ==, 1);
+  g_assert_cmpuint(caller_problems(f), ==, 1);
+}
+
+static void
+test_made_static(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  publish(f, CALLEE_URI, 1, CHECKED);
+  publish(f, CALLEE_URI, 2, MADE_STATIC);
+  g_assert_cmpuint(caller_problems(f), ==, 1);
+}
+
+static void
+test_unchanged(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  struct summary_store_stats stats;
+
+  publish(f, CALLEE_URI, 1, CHECKED);
+  /* Another body, the same summary */
+  publish(f, CALLEE_URI, 2,
+          "gint\nchecked(gchar *str)\n{\n  g_assert(str);\n  return 1;\n}\n");
+  summary_store_get_stats(f->store, &stats);
+  g_assert_cmpuint(stats.updates, ==, 1);
+  g_assert_cmpuint(stats.entries, ==, 1);
+}
+
+static void
+test_reopened(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  publish(f, CALLEE_URI, 5, CHECKED);
+  /* Older versions do not replace newer ones */
+  publish(f, CALLEE_URI, 1, UNCHECKED);
+  g_assert_cmpuint(caller_problems(f), ==, 0);
+
+  /* Unless the file was opened again, its versions start over */
+  summary_store_forget(f->store, CALLEE_URI);
+  publish(f, CALLEE_URI, 1, UNCHECKED);
+  g_assert_cmpuint(caller_problems(f), ==, 1);
+}
+
+static void
+test_two_definitions(struct fixture *f, G_GNUC_UNUSED gconstpointer user_data)
+{
+  publish(f, CALLEE_URI, 1, CHECKED);
+  publish(f, OTHER_URI, 1, UNCHECKED);
+  /* Only what every definition asserts counts */
+  g_assert_cmpuint(caller_problems(f), ==, 1);
+
+  publish(f, OTHER_URI, 2, CHECKED);
+  g_assert_cmpuint(caller_problems(f), ==, 0);
+
+  publish(f, OTHER_URI, 3, UNCHECKED);
+  publish(f, CALLEE_URI, 2, RENAMED);
+  g_assert_cmpuint(caller_problems(f), ==, 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add("/message/process/summaries/removed", struct fixture, NULL,
+             fixture_set_up, test_removed, fixture_tear_down);
+  g_test_add("/message/process/summaries/renamed", struct fixture, NULL,
+             fixture_set_up, test_renamed, fixture_tear_down);
+  g_test_add("/message/process/summaries/made_static", struct fixture, NULL,
+             fixture_set_up, test_made_static, fixture_tear_down);
+  g_test_add("/message/process/summaries/unchanged", struct fixture, NULL,
+             fixture_set_up, test_unchanged, fixture_tear_down);
+  g_test_add("/message/process/summaries/reopened", struct fixture, NULL,
+             fixture_set_up, test_reopened, fixture_tear_down);
+  g_test_add("/message/process/summaries/two_definitions", struct fixture,
+             NULL, fixture_set_up, test_two_definitions, fixture_tear_down);
+
+  return g_test_run();
+}
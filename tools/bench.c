@@ -0,0 +1,146 @@
+#include <glib.h>
+#include <tree_sitter/api.h>
+
+#include "message.h"
+#include "parser.h"
+#include "process_asserts.h"
+#include "process_comments.h"
+#include "process_midscope.h"
+#include "visitor.h"
+
+/* Analyzes generated files with a growing number of top level declarations,
+ * the time per declaration should stay flat when the traversal is linear */
+
+#define DEFAULT_DECLARATIONS 10000
+#define STEPS 4
+/* Allowed growth of the time per declaration from the smallest file */
+#define MAX_GROWTH 3.0
+
+static gchar *
+generate(guint declarations)
+{
+  GString *s = g_string_new("#include <glib.h>\n\n");
+
+  for (guint i = 0; i < declarations; i++) {
+    switch (i % 4) {
+    case 0:
+      g_string_append_printf(s,
+                             "/**\n"
+                             " * @brief Documented %u\n"
+                             " *\n"
+                             " * @param self\n"
+                             " *\n"
+                             " * @return TRUE on success\n"
+                             " */\n"
+                             "gboolean documented_%u(gpointer self);\n\n",
+                             i, i);
+      break;
+    case 1:
+      g_string_append_printf(s, "void undocumented_%u(gpointer self);\n\n",
+                             i);
+      break;
+    case 2:
+      g_string_append_printf(s,
+                             "struct fields_%u {\n"
+                             "  /** Commented */\n"
+                             "  gint a;\n"
+                             "  gint b;\n"
+                             "};\n\n",
+                             i);
+      break;
+    default:
+      g_string_append_printf(s,
+                             "static gint\n"
+                             "helper_%u(gchar *str, gint *out)\n"
+                             "{\n"
+                             "  gint len;\n"
+                             "  g_assert(str);\n"
+                             "  len = strlen(str);\n"
+                             "  gint late = len;\n"
+                             "  return late;\n"
+                             "}\n\n",
+                             i);
+      break;
+    }
+  }
+
+  return g_string_free(s, FALSE);
+}
+
+/* Nanoseconds per declaration of one analysis */
+static gdouble
+run(visitor_t *visitor, guint declarations)
+{
+  message_t *msg;
+  GHashTable *ht;
+  parser_t *parser;
+  problems_t *issues = problems_new();
+  gint64 start;
+  gint64 time;
+
+  msg = g_malloc0(sizeof(*msg));
+  msg->type = MESSAGE_TYPE_OPEN;
+  msg->data.open.uri = g_strdup("file:///bench.c");
+  msg->data.open.text = generate(declarations);
+  msg->data.open.version = 1;
+  msg->data.open.language = g_strdup("c");
+
+  ht = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  parser = parser_new(msg, ht);
+
+  start = g_get_monotonic_time();
+  visitor_run(visitor, parser, NULL, NULL, issues);
+  time = g_get_monotonic_time() - start;
+
+  g_print("%6u declarations: %5u problems in %8ld us, %8.1f ns/declaration\n",
+          declarations, problems_len(issues), time,
+          time * 1000.0 / declarations);
+
+  problems_free(issues);
+  parser_unref(parser);
+  g_hash_table_unref(ht);
+
+  return time * 1000.0 / declarations;
+}
+
+int
+main(int argc, char *argv[])
+{
+  visitor_t *visitor;
+  guint declarations = DEFAULT_DECLARATIONS;
+  gdouble first = 0;
+  gdouble last = 0;
+
+  if (argc > 2) {
+    g_print("The only argument is the number of declarations\n");
+    return 1;
+  }
+  if (argc == 2) {
+    declarations = MAX(g_ascii_strtoull(argv[1], NULL, 10), 1 << STEPS);
+  }
+
+  visitor = visitor_new();
+  process_asserts_register(visitor, 0);
+  process_midscope_register(visitor, 1);
+  process_comments_register(visitor, 2);
+  visitor_compile(visitor);
+
+  /* Warm up allocator and caches */
+  run(visitor, declarations >> STEPS);
+
+  for (guint i = STEPS; i > 0; i--) {
+    last = run(visitor, declarations >> (i - 1));
+    if (first == 0) {
+      first = last;
+    }
+  }
+
+  visitor_free(visitor);
+
+  if (last > first * MAX_GROWTH) {
+    g_print("Time per declaration grew %.1fx, traversal is not linear\n",
+            last / first);
+    return 2;
+  }
+  return 0;
+}
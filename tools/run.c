@@ -7,6 +7,10 @@
 #include "process_asserts.h"
 #include "process_midscope.h"
 #include "process_comments.h"
+#include "visitor.h"
+
+/* Rule names, indexed like the rules of the visitor */
+static const gchar *const names[] = {"assert", "midscope", "comment", NULL};
 
 int
 main(int argc, char *argv[])
@@ -17,7 +21,10 @@ main(int argc, char *argv[])
   GHashTable *ht;
   parser_t *parser;
   GError *lerr = NULL;
-  GList *issues = NULL;
+  problems_t *issues = NULL;
+  gboolean enabled[G_N_ELEMENTS(names)] = {FALSE};
+  visitor_t *visitor;
+  guint rule = 0;
 
   if (argc < 3) {
     g_print("Add parser to use as the first arg\n");
@@ -47,24 +54,38 @@ main(int argc, char *argv[])
 
   parser = parser_new(msg, ht);
 
-  if (g_strcmp0(argv[1], "midscope") == 0) {
-    issues = process_midscope(parser, NULL);
-  }else if (g_strcmp0(argv[1], "comment") == 0) {
-    issues = process_comments(parser, NULL);
-  }else if (g_strcmp0(argv[1], "assert") == 0) {
-    issues = process_asserts(parser, NULL);
-  } else {
+  while (names[rule] != NULL && g_strcmp0(argv[1], names[rule]) != 0) {
+    rule++;
+  }
+  if (names[rule] == NULL) {
     g_print("Could not find parser %s\n", argv[1]);
     goto out;
   }
+  enabled[rule] = TRUE;
+
+  /* All rules share the query pass, as in the server */
+  visitor = visitor_new();
+  process_asserts_register(visitor, 0);
+  process_midscope_register(visitor, 1);
+  process_comments_register(visitor, 2);
+  visitor_compile(visitor);
+
+  issues = problems_new();
+  visitor_run(visitor, parser, enabled, NULL, issues);
+  problems_sort(issues);
+  visitor_free(visitor);
   g_print("Results:\n");
 
-  for (GList *r = issues; r != NULL; r = r->next) {
-    struct problem *p = r->data;
-    g_print("Issue: (%ld:%ld) -> (%ld:%ld): %s\n", p->range.start.line, p->range.start.character, p->range.end.line, p->range.end.character, p->msg);
+  for (guint i = 0; i < problems_len(issues); i++) {
+    struct problem *p = problems_get(issues, i);
+    GString *text = g_string_new(NULL);
+
+    problems_format(issues, p, text);
+    g_print("Issue: (%u:%u) -> (%u:%u): %s [%s]\n", p->start_line, p->start_char, p->end_line, p->end_char, text->str, rules_get(p->id)->code);
+    g_string_free(text, TRUE);
   }
 
-  g_list_free_full(issues, message_problem_free);
+  problems_free(issues);
 
 out:
   parser_unref(parser);